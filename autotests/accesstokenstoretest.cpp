@@ -0,0 +1,192 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QFile>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QTimer>
+
+#include "accesstokenstore.h"
+
+/// Secrets kept in memory, answering every request from the event loop like a keychain would.
+class MemorySecretStore : public SecretStore
+{
+    Q_OBJECT
+
+public:
+    using SecretStore::SecretStore;
+
+    QHash<QString, QByteArray> secrets;
+    bool failWrites = false;
+    /// Milliseconds until a write finishes, to let other requests overtake it
+    int writeDelay = 0;
+    int reads = 0;
+
+    void readSecret(const QString &key) override
+    {
+        ++reads;
+        QTimer::singleShot(0, this, [this, key] {
+            const auto it = secrets.constFind(key);
+            if (it == secrets.constEnd()) {
+                Q_EMIT readFinished(key, {}, EntryNotFound, QStringLiteral("Not found"));
+            } else {
+                Q_EMIT readFinished(key, *it, NoError, {});
+            }
+        });
+    }
+
+    void writeSecret(const QString &key, const QByteArray &secret) override
+    {
+        QTimer::singleShot(writeDelay, this, [this, key, secret] {
+            if (failWrites) {
+                Q_EMIT writeFinished(key, OtherError, QStringLiteral("Write failed"));
+                return;
+            }
+            secrets.insert(key, secret);
+            Q_EMIT writeFinished(key, NoError, {});
+        });
+    }
+
+    void deleteSecret(const QString &key) override
+    {
+        QTimer::singleShot(0, this, [this, key] {
+            const bool found = secrets.remove(key) > 0;
+            Q_EMIT deleteFinished(key, found ? NoError : EntryNotFound, {});
+        });
+    }
+};
+
+class AccessTokenStoreTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QString tokenFileName(const QString &userId)
+    {
+        QString fileName = userId;
+        fileName.replace(':', '_');
+        return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + '/' + fileName;
+    }
+
+    static QByteArray readTokenFile(const QString &userId)
+    {
+        QFile file(tokenFileName(userId));
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+    }
+
+    void cleanup()
+    {
+        QFile::remove(tokenFileName(QStringLiteral("@alice:example.org")));
+        QFile::remove(tokenFileName(QStringLiteral("@bob:example.org")));
+    }
+
+    void testConcurrentLoads()
+    {
+        auto secretStore = new MemorySecretStore;
+        secretStore->secrets.insert(QStringLiteral("@alice:example.org"), "alice-token");
+        secretStore->secrets.insert(QStringLiteral("@bob:example.org"), "bob-token");
+        AccessTokenStore store(secretStore);
+        QSignalSpy spy(&store, &AccessTokenStore::accessTokenLoaded);
+
+        store.loadAccessToken(QStringLiteral("@alice:example.org"));
+        store.loadAccessToken(QStringLiteral("@bob:example.org"));
+        // Both requests are out before either is answered
+        QCOMPARE(secretStore->reads, 2);
+        QCOMPARE(spy.count(), 0);
+
+        QTRY_COMPARE(spy.count(), 2);
+        QHash<QString, QByteArray> tokens;
+        for (const auto &arguments : qAsConst(spy)) {
+            tokens.insert(arguments.at(0).toString(), arguments.at(1).toByteArray());
+        }
+        QCOMPARE(tokens.value(QStringLiteral("@alice:example.org")), QByteArray("alice-token"));
+        QCOMPARE(tokens.value(QStringLiteral("@bob:example.org")), QByteArray("bob-token"));
+    }
+
+    void testMissingToken()
+    {
+        AccessTokenStore store(new MemorySecretStore);
+        QSignalSpy spy(&store, &AccessTokenStore::accessTokenLoaded);
+
+        store.loadAccessToken(QStringLiteral("@alice:example.org"));
+        QTRY_COMPARE(spy.count(), 1);
+        QVERIFY(spy.at(0).at(1).toByteArray().isEmpty());
+    }
+
+    void testMigrateFromFile()
+    {
+        const auto userId = QStringLiteral("@alice:example.org");
+        QFile file(tokenFileName(userId));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("file-token");
+        file.close();
+
+        auto secretStore = new MemorySecretStore;
+        AccessTokenStore store(secretStore);
+        QSignalSpy spy(&store, &AccessTokenStore::accessTokenLoaded);
+
+        store.loadAccessToken(userId);
+        QTRY_COMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(1).toByteArray(), QByteArray("file-token"));
+        // The file is removed once the token is in the store
+        QTRY_VERIFY(!QFile::exists(tokenFileName(userId)));
+        QCOMPARE(secretStore->secrets.value(userId), QByteArray("file-token"));
+    }
+
+    void testFailedWritesKeepTheLastToken()
+    {
+        const auto userId = QStringLiteral("@bob:example.org");
+        auto secretStore = new MemorySecretStore;
+        secretStore->failWrites = true;
+        AccessTokenStore store(secretStore);
+        QSignalSpy spy(secretStore, &SecretStore::writeFinished);
+
+        store.saveAccessToken(userId, "first-token");
+        store.saveAccessToken(userId, "second-token");
+        QTRY_COMPARE(spy.count(), 2);
+        QCOMPARE(readTokenFile(userId), QByteArray("second-token"));
+    }
+
+    void testDelete()
+    {
+        const auto userId = QStringLiteral("@alice:example.org");
+        auto secretStore = new MemorySecretStore;
+        secretStore->secrets.insert(userId, "alice-token");
+        AccessTokenStore store(secretStore);
+        QSignalSpy spy(secretStore, &SecretStore::deleteFinished);
+
+        store.deleteAccessToken(userId);
+        QTRY_COMPARE(spy.count(), 1);
+        QVERIFY(!secretStore->secrets.contains(userId));
+    }
+
+    void testDeleteDuringWrite()
+    {
+        const auto userId = QStringLiteral("@alice:example.org");
+        auto secretStore = new MemorySecretStore;
+        secretStore->writeDelay = 50;
+        AccessTokenStore store(secretStore);
+        QSignalSpy writes(secretStore, &SecretStore::writeFinished);
+        QSignalSpy deletes(secretStore, &SecretStore::deleteFinished);
+
+        // The write finishes after the delete and puts the token back
+        store.saveAccessToken(userId, "alice-token");
+        store.deleteAccessToken(userId);
+        QTRY_COMPARE(writes.count(), 1);
+        QTRY_COMPARE(deletes.count(), 2);
+        QVERIFY(!secretStore->secrets.contains(userId));
+        QVERIFY(readTokenFile(userId).isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(AccessTokenStoreTest)
+#include "accesstokenstoretest.moc"
@@ -0,0 +1,56 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QTest>
+
+#include "blurhash.h"
+
+class BlurHashBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testInvalidHash()
+    {
+        QVERIFY(BlurHash::decode(QString(), QSize(32, 32)).isNull());
+        // Two components announced, but the hash is too short for them
+        QVERIFY(BlurHash::decode(QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCM"), QSize(32, 32)).isNull());
+        // Not a base 83 digit
+        QVERIFY(BlurHash::decode(QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCMdn!"), QSize(32, 32)).isNull());
+        QVERIFY(BlurHash::decode(QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCMdnj"), QSize()).isNull());
+    }
+
+    void benchmarkDecode_data()
+    {
+        QTest::addColumn<QString>("hash");
+        QTest::addColumn<QSize>("size");
+
+        // The examples of the reference implementation
+        QTest::newRow("4x3 components, 32x32") << QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCMdnj") << QSize(32, 32);
+        QTest::newRow("4x3 components, 32x18") << QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCMdnj") << QSize(32, 18);
+        QTest::newRow("4x3 components, 256x256") << QStringLiteral("LEHV6nWB2yk8pyo0adR*.7kCMdnj") << QSize(256, 256);
+        // The most components a hash can have
+        QTest::newRow("9x9 components, 32x32")
+            << QStringLiteral(
+                   "|eEq8vNewerxC=agxok*z#vR6cx%1OkPPnsUNAI]:%kYrW~ksKl1dG$6E;M?#sE|pqce?D1f+M]x6QFy@.wS4ITy]~35}NQnksww:_cL:e^*gBc};;{4u_h?DJa69p3iDYm:LYPc+Rh4]?z:"
+                   "Txflo5~Lc7usYqqxvzeIvt")
+            << QSize(32, 32);
+    }
+
+    void benchmarkDecode()
+    {
+        QFETCH(QString, hash);
+        QFETCH(QSize, size);
+
+        QImage image;
+        QBENCHMARK {
+            image = BlurHash::decode(hash, size);
+        }
+        QCOMPARE(image.size(), size);
+    }
+};
+
+QTEST_GUILESS_MAIN(BlurHashBenchmark)
+#include "blurhashbenchmark.moc"
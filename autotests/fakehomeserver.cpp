@@ -0,0 +1,177 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "fakehomeserver.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSignalSpy>
+#include <QTcpSocket>
+
+#include "connection.h"
+
+FakeHomeserver::FakeHomeserver(QObject *parent)
+    : QTcpServer(parent)
+{
+    syncHandler = [this](const Request &) {
+        return Response {200, emptySync(QStringLiteral("s%1").arg(m_syncCount))};
+    };
+    connect(this, &QTcpServer::newConnection, this, [this] {
+        while (auto socket = nextPendingConnection()) {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket] {
+                while (readRequest(socket)) { }
+            });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    });
+    listen(QHostAddress::LocalHost);
+    m_startTime.start();
+}
+
+QUrl FakeHomeserver::url() const
+{
+    return QUrl(QStringLiteral("http://127.0.0.1:%1").arg(serverPort()));
+}
+
+Quotient::Connection *FakeHomeserver::logIn()
+{
+    auto connection = new Quotient::Connection(url());
+    QSignalSpy spy(connection, &Quotient::Connection::connected);
+    connection->assumeIdentity(QStringLiteral("@alice:example.org"), QStringLiteral("token"), QStringLiteral("DEVICE"));
+    if (spy.isEmpty() && !spy.wait()) {
+        delete connection;
+        return nullptr;
+    }
+    return connection;
+}
+
+const QVector<FakeHomeserver::Request> &FakeHomeserver::requests() const
+{
+    return m_requests;
+}
+
+QVector<FakeHomeserver::Request> FakeHomeserver::syncRequests() const
+{
+    QVector<Request> syncs;
+    std::copy_if(m_requests.cbegin(), m_requests.cend(), std::back_inserter(syncs), [](const Request &request) {
+        return request.path.endsWith(QLatin1String("/sync"));
+    });
+    return syncs;
+}
+
+bool FakeHomeserver::readRequest(QTcpSocket *socket)
+{
+    // A request is only read once it is complete; connections are kept alive
+    const auto data = socket->peek(socket->bytesAvailable());
+    const int headerEnd = data.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+        return false;
+    }
+    const auto headers = data.left(headerEnd).split('\n');
+    qint64 contentLength = 0;
+    for (const auto &header : headers) {
+        if (header.toLower().startsWith("content-length:")) {
+            contentLength = header.mid(int(qstrlen("content-length:"))).trimmed().toLongLong();
+        }
+    }
+    if (data.size() < headerEnd + 4 + contentLength) {
+        return false;
+    }
+    socket->read(headerEnd + 4 + contentLength);
+
+    const auto requestLine = headers.first().trimmed().split(' ');
+    if (requestLine.size() < 2) {
+        socket->disconnectFromHost();
+        return false;
+    }
+    const QUrl url(QString::fromUtf8(requestLine[1]));
+    const Request request {requestLine[0], url.path(), QUrlQuery(url), data.mid(headerEnd + 4, int(contentLength)), m_startTime.elapsed()};
+    m_requests += request;
+
+    const auto response = respond(request);
+    socket->write("HTTP/1.1 " + QByteArray::number(response.status) + (response.status < 400 ? " OK" : " Error")
+                  + "\r\nContent-Type: application/json\r\nContent-Length: " + QByteArray::number(response.body.size()) + "\r\n\r\n");
+    socket->write(response.body);
+    return true;
+}
+
+FakeHomeserver::Response FakeHomeserver::respond(const Request &request)
+{
+    const auto &path = request.path;
+    if (path.endsWith(QLatin1String("/sync"))) {
+        ++m_syncCount;
+        return syncHandler(request);
+    }
+    if (path == QLatin1String("/_matrix/client/versions")) {
+        return {200, R"({"versions": ["r0.5.0", "r0.6.1"]})"};
+    }
+    if (path.endsWith(QLatin1String("/login"))) {
+        return {200, R"({"flows": [{"type": "m.login.password"}]})"};
+    }
+    if (path.endsWith(QLatin1String("/account/whoami"))) {
+        return {200, R"({"user_id": "@alice:example.org"})"};
+    }
+    if (path.endsWith(QLatin1String("/filter")) && request.method == "POST") {
+        return {200, R"({"filter_id": "1"})"};
+    }
+    return {404, R"({"errcode": "M_UNRECOGNIZED", "error": "Unrecognized request"})"};
+}
+
+QByteArray FakeHomeserver::emptySync(const QString &nextBatch)
+{
+    return QJsonDocument(QJsonObject {{QStringLiteral("next_batch"), nextBatch}}).toJson(QJsonDocument::Compact);
+}
+
+QByteArray FakeHomeserver::initialSync(int rooms, int eventsPerRoom, const QString &nextBatch)
+{
+    const auto stateEvent = [](const QString &type, const QString &stateKey, const QJsonObject &content, int age) {
+        return QJsonObject {
+            {QStringLiteral("type"), type},
+            {QStringLiteral("state_key"), stateKey},
+            {QStringLiteral("sender"), QStringLiteral("@alice:example.org")},
+            {QStringLiteral("event_id"), QStringLiteral("$state%1-%2").arg(type, stateKey)},
+            {QStringLiteral("origin_server_ts"), 1600000000000 + age},
+            {QStringLiteral("content"), content},
+        };
+    };
+
+    QJsonObject joinedRooms;
+    for (int i = 0; i < rooms; ++i) {
+        const auto roomId = QStringLiteral("!room%1:example.org").arg(i);
+        const QJsonArray state {
+            stateEvent(QStringLiteral("m.room.create"), {}, {{QStringLiteral("creator"), QStringLiteral("@alice:example.org")}}, i),
+            stateEvent(QStringLiteral("m.room.name"), {}, {{QStringLiteral("name"), QStringLiteral("Room %1").arg(i)}}, i),
+            stateEvent(QStringLiteral("m.room.member"), QStringLiteral("@alice:example.org"), {{QStringLiteral("membership"), QStringLiteral("join")}}, i),
+        };
+        QJsonArray timeline;
+        for (int j = 0; j < eventsPerRoom; ++j) {
+            timeline.append(QJsonObject {
+                {QStringLiteral("type"), QStringLiteral("m.room.message")},
+                {QStringLiteral("sender"), QStringLiteral("@alice:example.org")},
+                {QStringLiteral("event_id"), QStringLiteral("$event%1-%2").arg(i).arg(j)},
+                {QStringLiteral("origin_server_ts"), 1600000000000 + i * eventsPerRoom + j},
+                {QStringLiteral("content"),
+                 QJsonObject {
+                     {QStringLiteral("msgtype"), QStringLiteral("m.text")},
+                     {QStringLiteral("body"), QStringLiteral("Message %1 in room %2, long enough to look like an actual message of a conversation").arg(j).arg(i)},
+                 }},
+            });
+        }
+        joinedRooms.insert(roomId,
+                           QJsonObject {
+                               {QStringLiteral("state"), QJsonObject {{QStringLiteral("events"), state}}},
+                               {QStringLiteral("timeline"), QJsonObject {{QStringLiteral("events"), timeline}, {QStringLiteral("limited"), true}}},
+                               {QStringLiteral("unread_notifications"), QJsonObject {{QStringLiteral("notification_count"), i % 3}}},
+                           });
+    }
+    return QJsonDocument(QJsonObject {
+                             {QStringLiteral("next_batch"), nextBatch},
+                             {QStringLiteral("rooms"), QJsonObject {{QStringLiteral("join"), joinedRooms}}},
+                         })
+        .toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,74 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QVector>
+
+#include <functional>
+
+namespace Quotient
+{
+class Connection;
+}
+
+/// A homeserver on localhost answering the requests a connection makes to
+/// log in and sync, for tests that don't want to reach a real server.
+///
+/// Every request is recorded. Syncs are answered by the sync handler, which
+/// returns an empty sync with an increasing batch token by default; other
+/// requests get a minimal valid answer or a 404.
+class FakeHomeserver : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    struct Request {
+        QByteArray method;
+        QString path;
+        QUrlQuery query;
+        QByteArray body;
+        /// Milliseconds since the server was started
+        qint64 time;
+    };
+
+    struct Response {
+        int status = 200;
+        QByteArray body;
+    };
+
+    explicit FakeHomeserver(QObject *parent = nullptr);
+
+    [[nodiscard]] QUrl url() const;
+
+    /// A new connection logged in to this server as @alice:example.org, not
+    /// synced yet; null if logging in failed.
+    [[nodiscard]] Quotient::Connection *logIn();
+
+    /// Answers the syncs; the default handler returns empty syncs
+    std::function<Response(const Request &request)> syncHandler;
+
+    [[nodiscard]] const QVector<Request> &requests() const;
+    [[nodiscard]] QVector<Request> syncRequests() const;
+
+    /// A sync response joining \p rooms rooms with \p eventsPerRoom messages
+    /// each, as a server would send for the initial sync of a large account.
+    [[nodiscard]] static QByteArray initialSync(int rooms, int eventsPerRoom, const QString &nextBatch);
+    [[nodiscard]] static QByteArray emptySync(const QString &nextBatch);
+
+private:
+    QVector<Request> m_requests;
+    QElapsedTimer m_startTime;
+    int m_syncCount = 0;
+
+    /// Read and answer the next request if it is complete
+    bool readRequest(QTcpSocket *socket);
+    [[nodiscard]] Response respond(const Request &request);
+};
@@ -0,0 +1,130 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QFile>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+#include "connection.h"
+#include "fakehomeserver.h"
+#include "neochatconfig.h"
+#include "neochatroom.h"
+#include "roomlistmodel.h"
+#include "syncscheduler.h"
+
+using namespace Quotient;
+
+/// The initial sync of a large account, applied while the room list shows
+/// the rooms that are already in.
+///
+/// The benchmark serves the response recorded in the file named by
+/// NEOCHAT_RECORDED_SYNC if set, or a generated one.
+class InitialSyncTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray recordedSync()
+    {
+        QFile file(qEnvironmentVariable("NEOCHAT_RECORDED_SYNC"));
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+    /// Serves \p initialSync to the first sync and empty syncs after it
+    static void serveInitialSync(FakeHomeserver &server, const QByteArray &initialSync)
+    {
+        server.syncHandler = [initialSync](const FakeHomeserver::Request &request) {
+            if (!request.query.hasQueryItem(QStringLiteral("since"))) {
+                return FakeHomeserver::Response {200, initialSync};
+            }
+            return FakeHomeserver::Response {200, FakeHomeserver::emptySync(request.query.queryItemValue(QStringLiteral("since")))};
+        };
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+        Connection::setRoomType<NeoChatRoom>();
+    }
+
+    void testRoomsShowUpWhileApplied()
+    {
+        FakeHomeserver server;
+        serveInitialSync(server, FakeHomeserver::initialSync(200, 5, QStringLiteral("s1")));
+        const auto priorityRoomId = QStringLiteral("!room150:example.org");
+        NeoChatConfig::self()->setOpenRoom(priorityRoomId);
+
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        RoomListModel model;
+        model.setConnection(connection);
+
+        int firstChunkRows = -1;
+        bool priorityRoomFirst = false;
+        connect(scheduler, &SyncScheduler::syncApplied, this, [&] {
+            if (firstChunkRows < 0) {
+                firstChunkRows = model.rowCount();
+                priorityRoomFirst = connection->room(priorityRoomId) != nullptr;
+            }
+        });
+        QSignalSpy syncDone(connection, &Connection::syncDone);
+        scheduler->start();
+        QVERIFY(syncDone.wait(30000));
+        scheduler->stop();
+
+        // The first chunk is small and starts with the room that was open last
+        QVERIFY(firstChunkRows > 0);
+        QVERIFY(firstChunkRows < 200);
+        QVERIFY(priorityRoomFirst);
+        QCOMPARE(model.rowCount(), 200);
+        QVERIFY(scheduler->timeToFirstRooms() >= 0);
+        QCOMPARE(server.syncRequests().first().query.queryItemValue(QStringLiteral("timeout")), QStringLiteral("0"));
+        model.setConnection(nullptr);
+        delete connection;
+    }
+
+    void benchmarkInitialSync_data()
+    {
+        QTest::addColumn<QByteArray>("response");
+
+        const auto recorded = recordedSync();
+        if (!recorded.isEmpty()) {
+            QTest::newRow("recorded") << recorded;
+            return;
+        }
+        QTest::newRow("500 rooms") << FakeHomeserver::initialSync(500, 20, QStringLiteral("s1"));
+        QTest::newRow("2000 rooms") << FakeHomeserver::initialSync(2000, 20, QStringLiteral("s1"));
+    }
+
+    void benchmarkInitialSync()
+    {
+        QFETCH(QByteArray, response);
+
+        FakeHomeserver server;
+        serveInitialSync(server, response);
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        RoomListModel model;
+        model.setConnection(connection);
+
+        QSignalSpy syncDone(connection, &Connection::syncDone);
+        QBENCHMARK_ONCE {
+            scheduler->start();
+            QVERIFY(syncDone.wait(120000));
+        }
+        scheduler->stop();
+        qInfo() << response.size() << "bytes," << model.rowCount() << "rooms; first rooms shown after" << scheduler->timeToFirstRooms() << "ms, applied in"
+                << scheduler->processingTime() << "ms";
+        model.setConnection(nullptr);
+        delete connection;
+    }
+};
+
+QTEST_MAIN(InitialSyncTest)
+#include "initialsynctest.moc"
@@ -0,0 +1,104 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+#include "connection.h"
+#include "neochatroom.h"
+#include "roomlistmodel.h"
+
+using namespace Quotient;
+
+/// A connection that never talks to a server; rooms are created directly.
+class OfflineConnection : public Connection
+{
+    Q_OBJECT
+
+public:
+    using Connection::provideRoom;
+
+    void addRooms(int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            provideRoom(QStringLiteral("!room%1:example.org").arg(i), JoinState::Join);
+        }
+    }
+};
+
+/// The room list on every signal of a room, as sent while syncs are applied.
+class RoomListModelBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+        Connection::setRoomType<NeoChatRoom>();
+    }
+
+    void testSignalsUpdateTheirRow()
+    {
+        OfflineConnection connection;
+        connection.addRooms(100);
+        RoomListModel model;
+        model.setConnection(&connection);
+        QCOMPARE(model.rowCount(), 100);
+        QSignalSpy spy(&model, &QAbstractItemModel::dataChanged);
+
+        const auto rooms = connection.allRooms();
+        for (const auto room : rooms) {
+            spy.clear();
+            Q_EMIT room->avatarChanged();
+            QCOMPARE(spy.count(), 1);
+            const auto index = spy.at(0).at(0).toModelIndex();
+            QCOMPARE(index.data(RoomListModel::RoomIdRole).toString(), room->id());
+        }
+    }
+
+    void benchmarkSignals_data()
+    {
+        QTest::addColumn<int>("roomCount");
+        QTest::addColumn<bool>("transaction");
+
+        for (const int roomCount : {100, 1500, 5000}) {
+            QTest::addRow("%d rooms", roomCount) << roomCount << false;
+            QTest::addRow("%d rooms in a transaction", roomCount) << roomCount << true;
+        }
+    }
+
+    void benchmarkSignals()
+    {
+        QFETCH(int, roomCount);
+        QFETCH(bool, transaction);
+
+        OfflineConnection connection;
+        connection.addRooms(roomCount);
+        RoomListModel model;
+        model.setConnection(&connection);
+        QCOMPARE(model.rowCount(), roomCount);
+
+        // What a sync touching every room of the account sends
+        const auto rooms = connection.allRooms();
+        QBENCHMARK {
+            if (transaction) {
+                model.beginTransaction();
+            }
+            for (const auto room : rooms) {
+                Q_EMIT room->unreadMessagesChanged(room);
+                Q_EMIT room->avatarChanged();
+                Q_EMIT room->tagsChanged();
+            }
+            if (transaction) {
+                model.endTransaction();
+            }
+        }
+    }
+};
+
+QTEST_MAIN(RoomListModelBenchmark)
+#include "roomlistmodelbenchmark.moc"
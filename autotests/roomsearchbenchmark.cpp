@@ -0,0 +1,80 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QTest>
+
+#include "roomsearchindex.h"
+
+/// Scoring a room list of the size of a large account against a search text,
+/// which has to stay below a millisecond to keep up with typing.
+class RoomSearchBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int RoomCount = 2000;
+    QVector<QVector<RoomSearchIndex::Field>> m_rooms;
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        const QStringList words = {
+            QStringLiteral("KDE"),
+            QStringLiteral("Développement"),
+            QStringLiteral("Plasma"),
+            QStringLiteral("Matrix"),
+            QStringLiteral("Offtopic"),
+            QStringLiteral("Community"),
+            QStringLiteral("Release"),
+            QStringLiteral("Translation"),
+        };
+        const auto topic = QStringLiteral(
+            "Welcome! Please read the code of conduct before posting. Discussion about the development of the project, "
+            "its releases and infrastructure. Logs are public. Bridged to IRC and Telegram, be patient with replies.");
+
+        m_rooms.reserve(RoomCount);
+        for (int i = 0; i < RoomCount; ++i) {
+            const auto name = QStringLiteral("%1 %2 %3").arg(words[i % words.size()], words[(i / words.size()) % words.size()]).arg(i);
+            const auto alias = QStringLiteral("#room-%1:example.org").arg(i);
+            const QStringList directChatUsers = i % 10 == 0 ? QStringList {QStringLiteral("User %1").arg(i), QStringLiteral("@user%1:example.org").arg(i)} : QStringList();
+            m_rooms += RoomSearchIndex::fields(name, alias, {QStringLiteral("#alt-%1:example.org").arg(i)}, topic, directChatUsers);
+        }
+    }
+
+    void benchmarkSearch_data()
+    {
+        QTest::addColumn<QString>("text");
+        QTest::addColumn<bool>("matches");
+
+        QTest::newRow("prefix") << QStringLiteral("plas") << true;
+        QTest::newRow("word") << QStringLiteral("comm") << true;
+        QTest::newRow("diacritics") << QStringLiteral("developpement") << true;
+        QTest::newRow("subsequence") << QStringLiteral("kdedev") << true;
+        QTest::newRow("two terms") << QStringLiteral("matrix release") << true;
+        QTest::newRow("topic") << QStringLiteral("telegram") << true;
+        QTest::newRow("no match") << QStringLiteral("zzzz") << false;
+    }
+
+    void benchmarkSearch()
+    {
+        QFETCH(QString, text);
+        QFETCH(bool, matches);
+
+        const auto terms = RoomSearchIndex::searchTerms(text);
+        int found = 0;
+        QBENCHMARK {
+            found = 0;
+            for (const auto &fields : qAsConst(m_rooms)) {
+                if (RoomSearchIndex::score(fields, terms) > 0) {
+                    ++found;
+                }
+            }
+        }
+        QCOMPARE(found > 0, matches);
+    }
+};
+
+QTEST_GUILESS_MAIN(RoomSearchBenchmark)
+#include "roomsearchbenchmark.moc"
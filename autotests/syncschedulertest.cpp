@@ -0,0 +1,133 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QGuiApplication>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QWindow>
+
+#include "connection.h"
+#include "fakehomeserver.h"
+#include "neochatconfig.h"
+#include "neochatroom.h"
+#include "syncscheduler.h"
+
+using namespace Quotient;
+
+class SyncSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QString timeoutOf(const FakeHomeserver::Request &request)
+    {
+        return request.query.queryItemValue(QStringLiteral("timeout"));
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+        Connection::setRoomType<NeoChatRoom>();
+    }
+
+    void testForegroundLongPolls()
+    {
+        FakeHomeserver server;
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        QCOMPARE(scheduler->state(), SyncScheduler::Foreground);
+
+        scheduler->start();
+        QTRY_VERIFY(server.syncRequests().size() >= 3);
+        // Syncs use the uploaded filter once its id is known
+        QTRY_VERIFY(server.syncRequests().last().query.queryItemValue(QStringLiteral("filter")) == QLatin1String("1"));
+        scheduler->stop();
+
+        const auto syncs = server.syncRequests();
+        QVERIFY(!syncs[0].query.hasQueryItem(QStringLiteral("since")));
+        QCOMPARE(timeoutOf(syncs[0]), QStringLiteral("0"));
+        QCOMPARE(syncs[1].query.queryItemValue(QStringLiteral("since")), QStringLiteral("s1"));
+        QCOMPARE(timeoutOf(syncs[1]), QStringLiteral("30000"));
+        QVERIFY(scheduler->syncsPerHour() >= 2);
+        QVERIFY(scheduler->bytesReceived() > 0);
+        delete connection;
+    }
+
+    void testFailuresBackOff()
+    {
+        // Failed syncs on a SyncThread fail right away, without the retries of a SyncJob
+        NeoChatConfig::self()->setThreadedSync(true);
+        FakeHomeserver server;
+        bool failing = false;
+        server.syncHandler = [&failing](const FakeHomeserver::Request &) {
+            if (failing) {
+                return FakeHomeserver::Response {500, R"({"errcode": "M_UNKNOWN", "error": "Internal server error"})"};
+            }
+            return FakeHomeserver::Response {200, FakeHomeserver::emptySync(QStringLiteral("s1"))};
+        };
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        QSignalSpy syncErrors(connection, &Connection::syncError);
+
+        scheduler->start();
+        QTRY_VERIFY(server.syncRequests().size() >= 2);
+        failing = true;
+        QTRY_COMPARE(scheduler->state(), SyncScheduler::Failing);
+        QVERIFY(syncErrors.count() >= 1);
+
+        // The first retry comes after a second, give or take a quarter
+        const int failedSyncs = server.syncRequests().size();
+        QTest::qWait(500);
+        QCOMPARE(server.syncRequests().size(), failedSyncs);
+        QTRY_VERIFY_WITH_TIMEOUT(server.syncRequests().size() > failedSyncs, 5000);
+        const auto syncs = server.syncRequests();
+        QVERIFY(syncs[failedSyncs].time - syncs[failedSyncs - 1].time >= 700);
+
+        failing = false;
+        QTRY_COMPARE_WITH_TIMEOUT(scheduler->state(), SyncScheduler::Foreground, 10000);
+        scheduler->stop();
+        delete connection;
+        NeoChatConfig::self()->setThreadedSync(false);
+    }
+
+    void testHiddenWindowSlowsDown()
+    {
+        FakeHomeserver server;
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        scheduler->start();
+        QTRY_VERIFY(server.syncRequests().size() >= 2);
+
+        // Created after the scheduler, like the main window of the application
+        QWindow window;
+        window.show();
+        window.requestActivate();
+        QTRY_COMPARE(QGuiApplication::focusWindow(), &window);
+        QCOMPARE(scheduler->state(), SyncScheduler::Foreground);
+
+        window.hide();
+        QTRY_COMPARE(scheduler->state(), SyncScheduler::Background);
+        // The sync running when the window was hidden ends, then the next one waits
+        QTest::qWait(200);
+        const int backgroundSyncs = server.syncRequests().size();
+        QTest::qWait(500);
+        QCOMPARE(server.syncRequests().size(), backgroundSyncs);
+
+        window.show();
+        window.requestActivate();
+        QTRY_COMPARE(scheduler->state(), SyncScheduler::Foreground);
+        QTRY_VERIFY(server.syncRequests().size() > backgroundSyncs);
+        scheduler->stop();
+        delete connection;
+    }
+};
+
+QTEST_MAIN(SyncSchedulerTest)
+#include "syncschedulertest.moc"
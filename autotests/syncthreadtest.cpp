@@ -0,0 +1,83 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+#include <QTimer>
+
+#include "connection.h"
+#include "fakehomeserver.h"
+#include "neochatconfig.h"
+#include "neochatroom.h"
+#include "roomlistmodel.h"
+#include "syncscheduler.h"
+
+using namespace Quotient;
+
+/// Syncs downloaded and parsed on a worker thread, with the GUI thread
+/// staying responsive while they are applied.
+class SyncThreadTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QStandardPaths::setTestModeEnabled(true);
+        Connection::setRoomType<NeoChatRoom>();
+        NeoChatConfig::self()->setThreadedSync(true);
+    }
+
+    void testLargeInitialSync()
+    {
+        // About 50 MB
+        const auto response = FakeHomeserver::initialSync(3000, 50, QStringLiteral("s1"));
+        FakeHomeserver server;
+        server.syncHandler = [&response](const FakeHomeserver::Request &request) {
+            if (!request.query.hasQueryItem(QStringLiteral("since"))) {
+                return FakeHomeserver::Response {200, response};
+            }
+            return FakeHomeserver::Response {200, FakeHomeserver::emptySync(request.query.queryItemValue(QStringLiteral("since")))};
+        };
+        auto connection = server.logIn();
+        QVERIFY(connection);
+        auto scheduler = new SyncScheduler(connection);
+        RoomListModel model;
+        model.setConnection(connection);
+
+        // Stands in for the frames QML renders: the longest time the event
+        // loop of the GUI thread didn't get to a 16 ms timer
+        qint64 longestFrame = 0;
+        QElapsedTimer frameTimer;
+        QTimer frames;
+        frames.setInterval(16);
+        connect(&frames, &QTimer::timeout, this, [&] {
+            longestFrame = qMax(longestFrame, frameTimer.restart());
+        });
+        QSignalSpy chunks(scheduler, &SyncScheduler::syncApplied);
+        QSignalSpy syncDone(connection, &Connection::syncDone);
+
+        frameTimer.start();
+        frames.start();
+        scheduler->start();
+        QVERIFY(syncDone.wait(300000));
+        frames.stop();
+        scheduler->stop();
+
+        QCOMPARE(model.rowCount(), 3000);
+        // 10 rooms first, then 50 per chunk
+        QCOMPARE(chunks.count(), 61);
+        qInfo() << response.size() << "bytes applied in" << scheduler->processingTime() << "ms; longest frame" << longestFrame << "ms";
+        QVERIFY2(longestFrame < 1000, qPrintable(QStringLiteral("The GUI thread was blocked for %1 ms").arg(longestFrame)));
+
+        model.setConnection(nullptr);
+        delete connection;
+    }
+};
+
+QTEST_MAIN(SyncThreadTest)
+#include "syncthreadtest.moc"
@@ -21,6 +21,8 @@ import NeoChat.Menu.Timeline 1.0
 Control {
     id: root
 
+    readonly property bool downloadQueued: currentRoom.queuedDownloads.indexOf(eventId) >= 0
+
     Layout.fillWidth: true
 
     Audio {
@@ -66,6 +68,11 @@ Control {
             Label {
                 text: model.display
             }
+            Label {
+                visible: downloadQueued
+                text: i18n("Waiting to download…")
+                color: Kirigami.Theme.disabledTextColor
+            }
         }
         RowLayout {
             visible: audio.hasAudio
@@ -114,7 +121,7 @@ Control {
         folderDialog.chosen.connect(function(path) {
             if (!path) return
 
-            currentRoom.downloadFile(eventId, path + "/" + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, path + "/" + currentRoom.fileNameToDownload(eventId))
         })
 
         folderDialog.open()
@@ -125,7 +132,7 @@ Control {
             openSavedFile()
         } else {
             openOnFinished = true
-            currentRoom.downloadFile(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
         }
     }
 
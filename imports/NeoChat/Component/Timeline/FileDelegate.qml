@@ -21,6 +21,7 @@ import NeoChat.Menu.Timeline 1.0
 RowLayout {
     property bool openOnFinished: false
     readonly property bool downloaded: progressInfo && progressInfo.completed
+    readonly property bool downloadQueued: currentRoom.queuedDownloads.indexOf(eventId) >= 0
 
     id: root
 
@@ -47,7 +48,8 @@ RowLayout {
 
                 Label {
                     Layout.fillWidth: true
-                    text: !progressInfo.completed && progressInfo.active ? (humanSize(progressInfo.progress) + "/" + humanSize(progressInfo.total)) : humanSize(content.info ? content.info.size : 0)
+                    text: downloadQueued ? i18n("Waiting to download…")
+                        : !progressInfo.completed && progressInfo.active ? (humanSize(progressInfo.progress) + "/" + humanSize(progressInfo.total)) : humanSize(content.info ? content.info.size : 0)
                     color: Kirigami.Theme.disabledTextColor
                     wrapMode: Label.Wrap
                 }
@@ -90,7 +92,7 @@ RowLayout {
                         fileMode: FileDialog.SaveFile
                         folder: StandardPaths.writableLocation(StandardPaths.DownloadLocation)
                         onAccepted: {
-                            currentRoom.downloadFile(eventId, file)
+                            currentRoom.queueDownload(eventId, file)
                         }
                     }
                 }
@@ -116,7 +118,7 @@ RowLayout {
         else
         {
             openOnFinished = true
-            currentRoom.downloadFile(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
         }
     }
 
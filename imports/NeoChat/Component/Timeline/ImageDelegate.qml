@@ -21,6 +21,7 @@ Image {
 
     property bool openOnFinished: false
     readonly property bool downloaded: progressInfo && progressInfo.completed
+    readonly property bool downloadQueued: currentRoom.queuedDownloads.indexOf(eventId) >= 0
 
     readonly property bool isThumbnail: !(content.info.thumbnail_info == null || content.thumbnailMediaId == null)
     //    readonly property var info: isThumbnail ? content.info.thumbnail_info : content.info
@@ -36,6 +37,20 @@ Image {
 
     fillMode: Image.PreserveAspectFit
 
+    Image {
+        anchors.fill: parent
+
+        // Shown until the thumbnail is there
+        visible: img.status !== Image.Ready
+        source: info["xyz.amorgan.blurhash"] ? "image://blurhash/" + encodeURIComponent(info["xyz.amorgan.blurhash"]) : ""
+
+        // Only the aspect ratio matters; not every event has the dimensions
+        sourceSize.width: info.w || img.width
+        sourceSize.height: info.h || img.height
+
+        fillMode: Image.PreserveAspectFit
+    }
+
     Control {
         anchors.bottom: parent.bottom
         anchors.bottomMargin: 8
@@ -69,7 +84,7 @@ Image {
     Rectangle {
         anchors.fill: parent
 
-        visible: progressInfo.active && !downloaded
+        visible: (progressInfo.active || downloadQueued) && !downloaded
 
         color: "#BB000000"
 
@@ -78,6 +93,8 @@ Image {
 
             width: parent.width * 0.8
 
+            // Waiting for the downloads that went first
+            indeterminate: downloadQueued
             from: 0
             to: progressInfo.total
             value: progressInfo.progress
@@ -155,7 +172,7 @@ Image {
             fileMode: FileDialog.SaveFile
             folder: StandardPaths.writableLocation(StandardPaths.DownloadLocation)
             onAccepted: {
-                currentRoom.downloadFile(eventId, file)
+                currentRoom.queueDownload(eventId, file)
             }
         }
     }
@@ -166,7 +183,7 @@ Image {
         else
         {
             openOnFinished = true
-            currentRoom.downloadFile(eventId, StandardPaths.writableLocation(StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, StandardPaths.writableLocation(StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
         }
     }
 
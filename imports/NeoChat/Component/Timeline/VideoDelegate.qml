@@ -24,6 +24,7 @@ Video {
     property bool openOnFinished: false
     property bool playOnFinished: false
     readonly property bool downloaded: progressInfo && progressInfo.completed
+    readonly property bool downloadQueued: currentRoom.queuedDownloads.indexOf(eventId) >= 0
 
     property bool supportStreaming: true
 
@@ -73,6 +74,22 @@ Video {
     }
 
     Image {
+        anchors.fill: parent
+
+        // Shown until the thumbnail is there
+        visible: (vid.playbackState == MediaPlayer.StoppedState || vid.error != MediaPlayer.NoError) && thumbnail.status !== Image.Ready
+        source: content.info["xyz.amorgan.blurhash"] ? "image://blurhash/" + encodeURIComponent(content.info["xyz.amorgan.blurhash"]) : ""
+
+        // Only the aspect ratio matters; not every event has the dimensions
+        sourceSize.width: content.info.w || vid.width
+        sourceSize.height: content.info.h || vid.height
+
+        fillMode: Image.PreserveAspectFit
+    }
+
+    Image {
+        id: thumbnail
+
         readonly property bool isThumbnail: content.info.thumbnail_info && content.thumbnailMediaId
         readonly property var info: isThumbnail ? content.info.thumbnail_info : content.info
 
@@ -138,7 +155,7 @@ Video {
     Rectangle {
         anchors.fill: parent
 
-        visible: progressInfo.active && !downloaded
+        visible: (progressInfo.active || downloadQueued) && !downloaded
 
         color: "#BB000000"
 
@@ -147,6 +164,8 @@ Video {
 
             width: parent.width * 0.8
 
+            // Waiting for the downloads that went first
+            indeterminate: downloadQueued
             from: 0
             to: progressInfo.total
             value: progressInfo.progress
@@ -213,7 +232,7 @@ Video {
         folderDialog.chosen.connect(function(path) {
             if (!path) return
 
-            currentRoom.downloadFile(eventId, path + "/" + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, path + "/" + currentRoom.fileNameToDownload(eventId))
         })
 
         folderDialog.open()
@@ -225,7 +244,7 @@ Video {
         else
         {
             openOnFinished = true
-            currentRoom.downloadFile(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
         }
     }
 
@@ -235,7 +254,7 @@ Video {
         else
         {
             playOnFinished = true
-            currentRoom.downloadFile(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
+            currentRoom.queueDownload(eventId, Platform.StandardPaths.writableLocation(Platform.StandardPaths.CacheLocation) + "/" + eventId.replace(":", "_").replace("/", "_").replace("+", "_") + currentRoom.fileNameToDownload(eventId))
         }
     }
 
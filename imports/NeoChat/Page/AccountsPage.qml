@@ -29,7 +29,7 @@ Kirigami.ScrollablePage {
 
                 text: model.user.displayName
                 subtitle: model.user.id
-                icon: model.connection.user.avatarMediaId ? "image://mxc/" + model.connection.user.avatarMediaId : "im-user"
+                icon: model.connection.user.avatarMediaId ? "image://mxc/" + encodeURIComponent(model.connection.localUserId) + "/" + model.connection.user.avatarMediaId : "im-user"
 
                 onClicked: {
                     Controller.activeConnection = model.connection
@@ -7,6 +7,7 @@
 import QtQuick 2.12
 import QtQuick.Controls 2.12 as QQC2
 import QtQuick.Layouts 1.12
+import Qt.labs.qmlmodels 1.0
 
 import org.kde.kirigami 2.13 as Kirigami
 import org.kde.kitemmodels 1.0
@@ -28,25 +29,53 @@ Kirigami.ScrollablePage {
     function goToNextRoom() {
         do {
             listView.incrementCurrentIndex();
-        } while (!listView.currentItem.visible && listView.currentIndex === listView.count)
-        listView.currentItem.action.trigger();
+        } while (listView.currentItem.isCategoryItem && listView.currentIndex !== listView.count - 1)
+        if (!listView.currentItem.isCategoryItem) {
+            listView.currentItem.action.trigger();
+        }
     }
 
     function goToPreviousRoom() {
         do {
             listView.decrementCurrentIndex();
-        } while (!listView.currentItem.visible && listView.currentIndex !== 0)
-        listView.currentItem.action.trigger();
+        } while (listView.currentItem.isCategoryItem && listView.currentIndex !== 0)
+        if (!listView.currentItem.isCategoryItem) {
+            listView.currentItem.action.trigger();
+        }
     }
 
     title: i18n("Rooms")
 
+    readonly property var syncScheduler: Controller.syncScheduler
+    readonly property bool initialSyncRunning: syncScheduler !== null && syncScheduler.initialSyncRunning
+
+    header: QQC2.Control {
+        visible: page.initialSyncRunning
+        padding: Kirigami.Units.smallSpacing
+        contentItem: ColumnLayout {
+            QQC2.Label {
+                Layout.fillWidth: true
+                elide: Text.ElideRight
+                text: page.syncScheduler && page.syncScheduler.initialSyncTotalRooms > 0
+                    ? i18n("Loading rooms: %1 of %2", page.syncScheduler.initialSyncRooms, page.syncScheduler.initialSyncTotalRooms)
+                    : i18n("Downloading rooms: %1 MB", page.syncScheduler ? (page.syncScheduler.initialSyncBytes / 1048576).toFixed(1) : 0)
+            }
+            QQC2.ProgressBar {
+                Layout.fillWidth: true
+                indeterminate: !page.syncScheduler || (page.syncScheduler.initialSyncTotalRooms === 0 && page.syncScheduler.initialSyncTotalBytes <= 0)
+                value: !page.syncScheduler ? 0
+                    : page.syncScheduler.initialSyncTotalRooms > 0 ? page.syncScheduler.initialSyncRooms / page.syncScheduler.initialSyncTotalRooms
+                    : page.syncScheduler.initialSyncBytes / Math.max(1, page.syncScheduler.initialSyncTotalBytes)
+            }
+        }
+    }
+
     titleDelegate: Kirigami.SearchField {
         Layout.topMargin: Kirigami.Units.smallSpacing
         Layout.bottomMargin: Kirigami.Units.smallSpacing
         Layout.fillHeight: true
         Layout.fillWidth: true
-        onTextChanged: sortFilterRoomListModel.filterText = text
+        onTextChanged: roomSearchModel.filterText = text
         KeyNavigation.tab: listView
     }
 
@@ -55,134 +84,184 @@ Kirigami.ScrollablePage {
         Kirigami.PlaceholderMessage {
             anchors.centerIn: parent
             width: parent.width - (Kirigami.Units.largeSpacing * 4)
-            visible: listView.count == 0
-            text: sortFilterRoomListModel.filterText.length > 0 ? i18n("No rooms found") : i18n("Join some rooms to get started")
+            visible: listView.count == 0 && !page.initialSyncRunning
+            text: roomSearchModel.filterText.length > 0 ? i18n("No rooms found") : i18n("Join some rooms to get started")
             helpfulAction: Kirigami.Action {
-                icon.name: sortFilterRoomListModel.filterText.length > 0 ? "search" : "list-add"
-                text: sortFilterRoomListModel.filterText.length > 0 ? i18n("Search in room directory") : i18n("Explore rooms")
-                onTriggered: pageStack.layers.push("qrc:/imports/NeoChat/Page/JoinRoomPage.qml", {"connection": activeConnection, "keyword": sortFilterRoomListModel.filterText})
+                icon.name: roomSearchModel.filterText.length > 0 ? "search" : "list-add"
+                text: roomSearchModel.filterText.length > 0 ? i18n("Search in room directory") : i18n("Explore rooms")
+                onTriggered: pageStack.layers.push("qrc:/imports/NeoChat/Page/JoinRoomPage.qml", {"connection": activeConnection, "keyword": roomSearchModel.filterText})
             }
         }
-        model:  SortFilterRoomListModel {
+        SortFilterRoomListModel {
             id: sortFilterRoomListModel
             sourceModel: roomListModel
             roomSortOrder: Config.mergeRoomList ? SortFilterRoomListModel.LastActivity : SortFilterRoomListModel.Categories
         }
-
-        section.property: sortFilterRoomListModel.filterText.length === 0 && !Config.mergeRoomList ? "category" : null
-        section.delegate: Kirigami.ListSectionHeader {
-            id: sectionHeader
-            action: Kirigami.Action {
-                onTriggered: roomListModel.setCategoryVisible(section, !roomListModel.categoryVisible(section))
-            }
-            contentItem: RowLayout {
-                implicitHeight: categoryName.implicitHeight
-                Kirigami.Icon {
-                    source: roomListModel.categoryVisible(section) ? "go-up" : "go-down"
-                    implicitHeight: Kirigami.Units.iconSizes.small
-                    implicitWidth: Kirigami.Units.iconSizes.small
-                }
-                Kirigami.Heading {
-                    id: categoryName
-                    level: 3
-                    text: roomListModel.categoryName(section)
-                    Layout.fillWidth: true
-                }
+        RoomSearchModel {
+            id: roomSearchModel
+            sourceModel: roomListModel
+        }
+        RoomTreeModel {
+            id: roomTreeModel
+            sourceModel: roomListModel
+        }
+        KDescendantsProxyModel {
+            id: roomTreeListModel
+            model: roomTreeModel
+        }
+        model: roomSearchModel.filterText.length > 0 ? roomSearchModel : Config.mergeRoomList ? sortFilterRoomListModel : roomTreeListModel
+        onCountChanged: {
+            if (count > 0) {
+                Controller.reportRoomListShown(count);
             }
         }
 
-        delegate: Kirigami.AbstractListItem {
-            id: roomListItem
-            property bool itemVisible: model.categoryVisible || sortFilterRoomListModel.filterText.length > 0 || Config.mergeRoomList
-            visible: itemVisible
-            highlighted: roomManager.currentRoom && roomManager.currentRoom.name === name
-            focus: true
-            action: Kirigami.Action {
-                id: enterRoomAction
-                onTriggered: {
-                    if (category === RoomType.Invited) {
-                        roomManager.openInvitation(currentRoom);
-                    } else {
-                        var roomItem = roomManager.enterRoom(currentRoom)
-                        roomListItem.KeyNavigation.right = roomItem
-                        roomItem.focus = true;
+        delegate: DelegateChooser {
+            role: "isCategory"
+            DelegateChoice {
+                roleValue: true
+                delegate: Kirigami.ListSectionHeader {
+                    readonly property bool isCategoryItem: true
+                    width: listView.width
+                    action: Kirigami.Action {
+                        onTriggered: roomTreeModel.setCategoryExpanded(model.category, !model.expanded)
+                    }
+                    contentItem: RowLayout {
+                        implicitHeight: categoryName.implicitHeight
+                        Kirigami.Icon {
+                            source: model.expanded ? "go-up" : "go-down"
+                            implicitHeight: Kirigami.Units.iconSizes.small
+                            implicitWidth: Kirigami.Units.iconSizes.small
+                        }
+                        Kirigami.Heading {
+                            id: categoryName
+                            level: 3
+                            text: model.name
+                            Layout.fillWidth: true
+                        }
+                        QQC2.Label {
+                            text: model.notificationCount
+                            visible: !model.expanded && model.notificationCount > 0
+                            padding: Kirigami.Units.smallSpacing
+                            color: model.highlightCount > 0 ? "white" : Kirigami.Theme.textColor
+                            Layout.minimumWidth: height
+                            horizontalAlignment: Text.AlignHCenter
+                            background: Rectangle {
+                                Kirigami.Theme.colorSet: Kirigami.Theme.Button
+                                color: model.highlightCount > 0 ? Kirigami.Theme.positiveTextColor : Kirigami.Theme.backgroundColor
+                                radius: height / 2
+                            }
+                        }
                     }
                 }
             }
+            DelegateChoice {
+                delegate: Kirigami.AbstractListItem {
+                    id: roomListItem
+                    readonly property bool isCategoryItem: false
+                    // Rows of the last session's snapshot can't be opened until their account is connected
+                    // (accountCount is read to re-evaluate the binding when accounts connect)
+                    enabled: currentRoom !== null || (Controller.accountCount > 0 && Controller.isAccountConnected(model.account))
+                    highlighted: roomManager.currentRoom && roomManager.currentRoom.name === name
+                    focus: true
+                    action: Kirigami.Action {
+                        id: enterRoomAction
+                        onTriggered: {
+                            // Rooms whose cached state isn't loaded yet are loaded when opened
+                            const room = currentRoom ?? Controller.loadRoom(model.account, model.roomId);
+                            if (!room) {
+                                return;
+                            }
+                            // Rooms of every account are listed when they are merged
+                            if (room.connection !== Controller.activeConnection) {
+                                Controller.activeConnection = room.connection;
+                            }
+                            if (category === RoomType.Invited) {
+                                roomManager.openInvitation(room);
+                            } else {
+                                var roomItem = roomManager.enterRoom(room)
+                                roomListItem.KeyNavigation.right = roomItem
+                                roomItem.focus = true;
+                            }
+                        }
+                    }
 
 
-            contentItem: RowLayout {
-                id: roomLayout
-                spacing: Kirigami.Units.largeSpacing
-                width: listView.width
+                    contentItem: RowLayout {
+                        id: roomLayout
+                        spacing: Kirigami.Units.largeSpacing
+                        width: listView.width
 
-                TapHandler {
-                    acceptedButtons: Qt.RightButton
-                    gesturePolicy: TapHandler.ReleaseWithinBounds
-                    onTapped: roomListContextMenu.createObject(roomLayout, {"room": currentRoom}).popup()
-                }
+                        TapHandler {
+                            acceptedButtons: Qt.RightButton
+                            gesturePolicy: TapHandler.ReleaseWithinBounds
+                            onTapped: roomListContextMenu.createObject(roomLayout, {"room": currentRoom}).popup()
+                        }
 
-                TapHandler {
-                    onTapped: enterRoomAction.trigger()
-                    onLongPressed: roomListContextMenu.createObject(roomLayout, {"room": currentRoom}).popup()
-                }
+                        TapHandler {
+                            onTapped: enterRoomAction.trigger()
+                            onLongPressed: roomListContextMenu.createObject(roomLayout, {"room": currentRoom}).popup()
+                        }
 
-                Kirigami.Avatar {
-                    id: roomAvatar
-                    property int size: Kirigami.Units.gridUnit * 2 + Kirigami.Units.smallSpacing
-                    Layout.minimumHeight: size
-                    Layout.maximumHeight: size
-                    Layout.minimumWidth: size
-                    Layout.maximumWidth: size
+                        Kirigami.Avatar {
+                            id: roomAvatar
+                            property int size: Kirigami.Units.gridUnit * 2 + Kirigami.Units.smallSpacing
+                            Layout.minimumHeight: size
+                            Layout.maximumHeight: size
+                            Layout.minimumWidth: size
+                            Layout.maximumWidth: size
 
-                    source: avatar ? "image://mxc/" + avatar : ""
-                    name: model.name || i18n("No Name")
-                }
+                            // Fetched by the account of the room, which need not be the active one
+                            source: avatar ? "image://mxc/" + (model.account ? encodeURIComponent(model.account) + "/" : "") + avatar : ""
+                            name: model.name || i18n("No Name")
+                        }
 
-                ColumnLayout {
-                    id: roomitemcolumn
-                    Layout.fillWidth: true
-                    Layout.fillHeight: true
-                    Layout.minimumHeight: Kirigami.Units.gridUnit * 2
-                    Layout.maximumHeight: Kirigami.Units.gridUnit * 2
-                    Layout.topMargin: Kirigami.Units.smallSpacing
-                    Layout.bottomMargin: Kirigami.Units.smallSpacing
-                    Layout.alignment: Qt.AlignHCenter
-
-                    spacing: Kirigami.Units.smallSpacing
-
-                    QQC2.Label {
-                        Layout.fillWidth: true
-                        Layout.fillHeight: true
-                        text: name ?? ""
-                        elide: Text.ElideRight
-                        font.bold: unreadCount >= 0 || highlightCount > 0 || notificationCount > 0
-                        wrapMode: Text.NoWrap
-                    }
+                        ColumnLayout {
+                            id: roomitemcolumn
+                            Layout.fillWidth: true
+                            Layout.fillHeight: true
+                            Layout.minimumHeight: Kirigami.Units.gridUnit * 2
+                            Layout.maximumHeight: Kirigami.Units.gridUnit * 2
+                            Layout.topMargin: Kirigami.Units.smallSpacing
+                            Layout.bottomMargin: Kirigami.Units.smallSpacing
+                            Layout.alignment: Qt.AlignHCenter
 
-                    QQC2.Label {
-                        Layout.fillWidth: true
-                        Layout.fillHeight: true
-                        Layout.alignment: Qt.AlignHCenter
+                            spacing: Kirigami.Units.smallSpacing
 
-                        text: (lastEvent == "" ? topic : lastEvent).replace(/(\r\n\t|\n|\r\t)/gm," ")
-                        visible: text.length > 0
-                        elide: Text.ElideRight
-                        wrapMode: Text.NoWrap
-                        color: Qt.rgba(Kirigami.Theme.textColor.r, Kirigami.Theme.textColor.g, Kirigami.Theme.textColor.b, 0.7)
-                    }
-                }
-                QQC2.Label {
-                    text: notificationCount
-                    visible: notificationCount > 0
-                    padding: Kirigami.Units.smallSpacing
-                    color: highlightCount > 0 ? "white" : Kirigami.Theme.textColor
-                    Layout.minimumWidth: height
-                    horizontalAlignment: Text.AlignHCenter
-                    background: Rectangle {
-                        Kirigami.Theme.colorSet: Kirigami.Theme.Button
-                        color: highlightCount > 0 ? Kirigami.Theme.positiveTextColor : Kirigami.Theme.backgroundColor
-                        radius: height / 2
+                            QQC2.Label {
+                                Layout.fillWidth: true
+                                Layout.fillHeight: true
+                                text: name ?? ""
+                                elide: Text.ElideRight
+                                font.bold: unreadCount >= 0 || highlightCount > 0 || notificationCount > 0
+                                wrapMode: Text.NoWrap
+                            }
+
+                            QQC2.Label {
+                                Layout.fillWidth: true
+                                Layout.fillHeight: true
+                                Layout.alignment: Qt.AlignHCenter
+
+                                text: (lastEvent == "" ? topic : lastEvent).replace(/(\r\n\t|\n|\r\t)/gm," ")
+                                visible: text.length > 0
+                                elide: Text.ElideRight
+                                wrapMode: Text.NoWrap
+                                color: Qt.rgba(Kirigami.Theme.textColor.r, Kirigami.Theme.textColor.g, Kirigami.Theme.textColor.b, 0.7)
+                            }
+                        }
+                        QQC2.Label {
+                            text: notificationCount
+                            visible: notificationCount > 0
+                            padding: Kirigami.Units.smallSpacing
+                            color: highlightCount > 0 ? "white" : Kirigami.Theme.textColor
+                            Layout.minimumWidth: height
+                            horizontalAlignment: Text.AlignHCenter
+                            background: Rectangle {
+                                Kirigami.Theme.colorSet: Kirigami.Theme.Button
+                                color: highlightCount > 0 ? Kirigami.Theme.positiveTextColor : Kirigami.Theme.backgroundColor
+                                radius: height / 2
+                            }
+                        }
                     }
                 }
             }
@@ -100,8 +100,19 @@ Kirigami.ScrollablePage {
 
         model: !isLoaded ? undefined : sortedMessageEventModel
 
-        onContentYChanged: updateReadMarker()
-        onCountChanged: updateReadMarker()
+        onContentYChanged: {
+            updateReadMarker()
+            prefetchThumbnails()
+        }
+        onCountChanged: {
+            updateReadMarker()
+            prefetchThumbnails()
+        }
+
+        function prefetchThumbnails() {
+            const center = contentX + width / 2
+            thumbnailPrefetcher.setVisibleRange(indexAt(center, contentY), indexAt(center, contentY + height - 1))
+        }
 
         function updateReadMarker() {
             if(!noNeedMoreContent && contentY  - 5000 < originY)
@@ -124,6 +135,14 @@ Kirigami.ScrollablePage {
             room: currentRoom
         }
 
+        ThumbnailPrefetcher {
+            id: thumbnailPrefetcher
+
+            model: sortedMessageEventModel
+            // As in MessageDelegate
+            avatarSize: Kirigami.Units.gridUnit * 2
+        }
+
         Kirigami.PlaceholderMessage {
             anchors.centerIn: parent
             visible: messageListView.count === 0 && !currentRoom.allHistoryLoaded
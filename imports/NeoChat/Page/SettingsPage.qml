@@ -40,11 +40,81 @@ Kirigami.ScrollablePage {
             checked: Config.mergeRoomList
             onToggled: Config.mergeRoomList = true
         }
+        QQC2.CheckBox {
+            Kirigami.FormData.label: i18n("Accounts:")
+            text: i18n("Show the rooms of all accounts in one list")
+            checked: Config.mergeAccounts
+            onToggled: Config.mergeAccounts = checked
+        }
         QQC2.CheckBox {
             Kirigami.FormData.label: i18n("Timeline:")
             text: i18n("Show User Avatar")
             checked: Config.showAvatarInTimeline
             onToggled: Config.showAvatarInTimeline = checked
         }
+        QQC2.CheckBox {
+            Kirigami.FormData.label: i18n("Synchronization:")
+            text: i18n("Process synchronization in the background (requires restart)")
+            checked: Config.threadedSync
+            onToggled: Config.threadedSync = checked
+        }
+        RowLayout {
+            Kirigami.FormData.label: i18n("Media cache:")
+            QQC2.SpinBox {
+                from: 10
+                to: 100000
+                stepSize: 50
+                value: Config.mediaCacheSize
+                textFromValue: function(value) {
+                    return i18n("%1 MiB", value)
+                }
+                valueFromText: function(text) {
+                    return parseInt(text)
+                }
+                onValueModified: {
+                    Config.mediaCacheSize = value
+                    MediaCacheManager.trim()
+                }
+            }
+            QQC2.Label {
+                text: i18n("%1 used", Qt.locale().formattedDataSize(MediaCacheManager.usage))
+            }
+            QQC2.Button {
+                text: i18n("Clear")
+                onClicked: MediaCacheManager.clear()
+            }
+        }
+        RowLayout {
+            Kirigami.FormData.label: i18n("Images in memory:")
+            QQC2.SpinBox {
+                from: 8
+                to: 4096
+                stepSize: 16
+                value: Config.imageMemoryCacheSize
+                textFromValue: function(value) {
+                    return i18n("%1 MiB", value)
+                }
+                valueFromText: function(text) {
+                    return parseInt(text)
+                }
+                onValueModified: {
+                    Config.imageMemoryCacheSize = value
+                    MediaCacheManager.trim()
+                }
+            }
+            QQC2.Label {
+                text: i18n("%1 used, %2% of the images found in memory", Qt.locale().formattedDataSize(MediaCacheManager.memoryUsage), Math.round(MediaCacheManager.memoryHitRate * 100))
+            }
+        }
+        QQC2.SpinBox {
+            Kirigami.FormData.label: i18n("Parallel media downloads per server:")
+            from: 1
+            to: 32
+            value: Config.mediaJobsPerHost
+            onValueModified: {
+                Config.mediaJobsPerHost = value
+                MediaJobScheduler.startQueued()
+            }
+        }
     }
 }
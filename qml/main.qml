@@ -197,6 +197,13 @@ Kirigami.ApplicationWindow {
 
     pageStack.initialPage: LoadingPage {}
 
+    Component.onCompleted: {
+        // Show the room list snapshot of the last session while the accounts connect
+        if (mergedRoomListModel.rowCount() > 0) {
+            roomManager.roomList = pageStack.replace(roomListComponent);
+        }
+    }
+
     Component {
         id: roomListComponent
         RoomListPage {
@@ -213,7 +220,9 @@ Kirigami.ApplicationWindow {
             if (Controller.accountCount === 0) {
                 pageStack.replace("qrc:/imports/NeoChat/Page/LoginPage.qml", {});
             } else {
-                roomManager.roomList = pageStack.replace(roomListComponent, {'activeConnection': Controller.activeConnection});
+                if (!roomManager.roomList) {
+                    roomManager.roomList = pageStack.replace(roomListComponent);
+                }
                 roomManager.loadInitialRoom();
             }
         }
@@ -244,10 +253,17 @@ Kirigami.ApplicationWindow {
         }
     }
 
-    RoomListModel {
+    MergedRoomListModel {
+        id: mergedRoomListModel
+
+        onNotificationCountChanged: Controller.setUnreadCounts(notificationCount, highlightCount)
+    }
+
+    AccountFilterModel {
         id: spectralRoomListModel
 
-        connection: Controller.activeConnection
+        sourceModel: mergedRoomListModel
+        accountId: Config.mergeAccounts ? "" : Controller.activeConnection ? Controller.activeConnection.localUserId : Config.activeConnection
     }
 
     Component {
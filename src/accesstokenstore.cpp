@@ -0,0 +1,140 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "accesstokenstore.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+AccessTokenStore::AccessTokenStore(SecretStore *secretStore, QObject *parent)
+    : QObject(parent)
+    , m_secretStore(secretStore)
+{
+    m_secretStore->setParent(this);
+    connect(m_secretStore, &SecretStore::readFinished, this, &AccessTokenStore::onReadFinished);
+    connect(m_secretStore, &SecretStore::writeFinished, this, &AccessTokenStore::onWriteFinished);
+    connect(m_secretStore, &SecretStore::deleteFinished, this, [](const QString &userId, SecretStore::Error error, const QString &errorString) {
+        if (error != SecretStore::NoError && error != SecretStore::EntryNotFound) {
+            qWarning() << "Could not delete the access token of" << userId << "from the keychain:" << errorString;
+        }
+    });
+}
+
+QString AccessTokenStore::accessTokenFileName(const QString &userId)
+{
+    QString fileName = userId;
+    fileName.replace(':', '_');
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + '/' + fileName;
+}
+
+void AccessTokenStore::loadAccessToken(const QString &userId)
+{
+    qDebug() << "Read the access token from the keychain for " << userId;
+    m_secretStore->readSecret(userId);
+}
+
+void AccessTokenStore::onReadFinished(const QString &userId, const QByteArray &accessToken, SecretStore::Error error, const QString &errorString)
+{
+    if (error == SecretStore::NoError) {
+        Q_EMIT accessTokenLoaded(userId, accessToken);
+        return;
+    }
+
+    qWarning() << "Could not read the access token from the keychain: " << qPrintable(errorString);
+    // no access token from the keychain, try token file
+    const auto fileAccessToken = loadAccessTokenFromFile(userId);
+    if (error == SecretStore::EntryNotFound && !fileAccessToken.isEmpty()) {
+        qDebug() << "Migrating the access token from file to the keychain for " << userId;
+        // The file is removed once the keychain confirms the write
+        saveAccessToken(userId, fileAccessToken);
+    }
+    Q_EMIT accessTokenLoaded(userId, fileAccessToken);
+}
+
+void AccessTokenStore::saveAccessToken(const QString &userId, const QByteArray &accessToken)
+{
+    qDebug() << "Save the access token to the keychain for " << userId;
+    // Written after the delete, so it ends up in the keychain anyway
+    m_deletedWhileWriting.remove(userId);
+    m_pendingWrites[userId].append(accessToken);
+    m_secretStore->writeSecret(userId, accessToken);
+}
+
+void AccessTokenStore::onWriteFinished(const QString &userId, SecretStore::Error error, const QString &errorString)
+{
+    auto it = m_pendingWrites.find(userId);
+    if (it == m_pendingWrites.end()) {
+        return;
+    }
+    const auto accessToken = it->takeFirst();
+    if (it->isEmpty()) {
+        m_pendingWrites.erase(it);
+    }
+    if (m_deletedWhileWriting.contains(userId)) {
+        // The token has been deleted in the meantime
+        if (!m_pendingWrites.contains(userId)) {
+            m_deletedWhileWriting.remove(userId);
+            QFile(accessTokenFileName(userId)).remove();
+            m_secretStore->deleteSecret(userId);
+        }
+        return;
+    }
+    if (error != SecretStore::NoError) {
+        qWarning() << "Could not save access token to the keychain: " << qPrintable(errorString);
+        if (!saveAccessTokenToFile(userId, accessToken)) {
+            qWarning() << "Couldn't save access token";
+        }
+        return;
+    }
+
+    QFile accountTokenFile {accessTokenFileName(userId)};
+    if (accountTokenFile.exists() && !accountTokenFile.remove()) {
+        qDebug() << "Migrating the access token from the file to the keychain "
+                    "failed";
+    }
+}
+
+void AccessTokenStore::deleteAccessToken(const QString &userId)
+{
+    if (m_pendingWrites.contains(userId)) {
+        m_deletedWhileWriting.insert(userId);
+    }
+    QFile(accessTokenFileName(userId)).remove();
+    m_secretStore->deleteSecret(userId);
+}
+
+QByteArray AccessTokenStore::loadAccessTokenFromFile(const QString &userId)
+{
+    QFile accountTokenFile {accessTokenFileName(userId)};
+    if (accountTokenFile.open(QFile::ReadOnly)) {
+        if (accountTokenFile.size() < 1024) {
+            return accountTokenFile.readAll();
+        }
+
+        qWarning() << "File" << accountTokenFile.fileName() << "is" << accountTokenFile.size() << "bytes long - too long for a token, ignoring it.";
+    }
+    qWarning() << "Could not open access token file" << accountTokenFile.fileName();
+
+    return {};
+}
+
+bool AccessTokenStore::saveAccessTokenToFile(const QString &userId, const QByteArray &accessToken)
+{
+    // (Re-)Make a dedicated file for access_token.
+    QFile accountTokenFile {accessTokenFileName(userId)};
+    accountTokenFile.remove(); // Just in case
+
+    auto fileDir = QFileInfo(accountTokenFile).dir();
+    if (!((fileDir.exists() || fileDir.mkpath(".")) && accountTokenFile.open(QFile::WriteOnly))) {
+        Q_EMIT errorOccured("I/O Denied", "Cannot save access token.");
+    } else {
+        accountTokenFile.write(accessToken);
+        return true;
+    }
+    return false;
+}
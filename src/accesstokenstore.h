@@ -0,0 +1,50 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QObject>
+#include <QSet>
+
+#include "secretstore.h"
+
+/// Loads and saves the access tokens of the accounts.
+///
+/// Tokens live in a SecretStore. A token file in the application data
+/// directory is used as a fallback when the store fails and is migrated
+/// into the store when found. All operations are asynchronous and may run
+/// concurrently for different accounts.
+class AccessTokenStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// The access token store takes ownership of \p secretStore.
+    explicit AccessTokenStore(SecretStore *secretStore, QObject *parent = nullptr);
+
+    void loadAccessToken(const QString &userId);
+    void saveAccessToken(const QString &userId, const QByteArray &accessToken);
+    void deleteAccessToken(const QString &userId);
+
+Q_SIGNALS:
+    /// The token is empty if it couldn't be found anywhere.
+    void accessTokenLoaded(const QString &userId, const QByteArray &accessToken);
+    void errorOccured(QString error, QString detail);
+
+private:
+    SecretStore *m_secretStore;
+    /// Tokens being written for each account, in the order of the writes
+    QHash<QString, QList<QByteArray>> m_pendingWrites;
+    /// Accounts deleted while writes were running, which may still put the
+    /// token back; they are deleted again once the last write has finished
+    QSet<QString> m_deletedWhileWriting;
+
+    void onReadFinished(const QString &userId, const QByteArray &accessToken, SecretStore::Error error, const QString &errorString);
+    void onWriteFinished(const QString &userId, SecretStore::Error error, const QString &errorString);
+
+    static QString accessTokenFileName(const QString &userId);
+    static QByteArray loadAccessTokenFromFile(const QString &userId);
+    bool saveAccessTokenToFile(const QString &userId, const QByteArray &accessToken);
+};
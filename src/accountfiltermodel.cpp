@@ -0,0 +1,50 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "accountfiltermodel.h"
+
+#include "mergedroomlistmodel.h"
+#include "roomlistmodel.h"
+
+AccountFilterModel::AccountFilterModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+}
+
+QString AccountFilterModel::accountId() const
+{
+    return m_accountId;
+}
+
+void AccountFilterModel::setAccountId(const QString &accountId)
+{
+    if (accountId == m_accountId) {
+        return;
+    }
+    m_accountId = accountId;
+    invalidateFilter();
+    Q_EMIT accountIdChanged();
+}
+
+int AccountFilterModel::categoryNotificationCount(int category) const
+{
+    const auto mergedModel = qobject_cast<MergedRoomListModel *>(sourceModel());
+    return mergedModel ? mergedModel->categoryNotificationCount(category, m_accountId) : 0;
+}
+
+int AccountFilterModel::categoryHighlightCount(int category) const
+{
+    const auto mergedModel = qobject_cast<MergedRoomListModel *>(sourceModel());
+    return mergedModel ? mergedModel->categoryHighlightCount(category, m_accountId) : 0;
+}
+
+bool AccountFilterModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+{
+    if (m_accountId.isEmpty()) {
+        return true;
+    }
+    const auto index = sourceModel()->index(source_row, 0, source_parent);
+    return sourceModel()->data(index, RoomListModel::AccountRole).toString() == m_accountId;
+}
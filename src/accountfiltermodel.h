@@ -0,0 +1,38 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QSortFilterProxyModel>
+
+/// The rooms of a MergedRoomListModel that belong to one account.
+///
+/// Switching the account only refilters the rows, the shards of the source
+/// model are left alone. Without an account all rooms are accepted.
+class AccountFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+    /// User ID of the account
+    Q_PROPERTY(QString accountId READ accountId WRITE setAccountId NOTIFY accountIdChanged)
+
+public:
+    explicit AccountFilterModel(QObject *parent = nullptr);
+
+    [[nodiscard]] QString accountId() const;
+    void setAccountId(const QString &accountId);
+
+    /// Category counters of the accepted rooms, see RoomListModel::categoryNotificationCount()
+    [[nodiscard]] int categoryNotificationCount(int category) const;
+    [[nodiscard]] int categoryHighlightCount(int category) const;
+
+protected:
+    [[nodiscard]] bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+
+Q_SIGNALS:
+    void accountIdChanged();
+
+private:
+    QString m_accountId;
+};
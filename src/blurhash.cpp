@@ -0,0 +1,152 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "blurhash.h"
+
+#include <QVector>
+#include <QtMath>
+
+#include <array>
+#include <cmath>
+
+namespace
+{
+const char Base83Characters[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+/// Value of every ASCII character in base 83, -1 for invalid ones
+const std::array<int, 128> &base83Values()
+{
+    static const auto values = [] {
+        std::array<int, 128> values;
+        values.fill(-1);
+        for (int i = 0; i < 83; ++i) {
+            values[Base83Characters[i]] = i;
+        }
+        return values;
+    }();
+    return values;
+}
+
+/// -1 for invalid input
+int decode83(const QString &hash, int from, int length)
+{
+    const auto &values = base83Values();
+    int value = 0;
+    for (int i = from; i < from + length; ++i) {
+        const auto c = hash[i].unicode();
+        if (c >= 128 || values[c] < 0) {
+            return -1;
+        }
+        value = value * 83 + values[c];
+    }
+    return value;
+}
+
+float sRgbToLinear(int value)
+{
+    static const auto table = [] {
+        std::array<float, 256> table;
+        for (int i = 0; i < 256; ++i) {
+            const float v = i / 255.0f;
+            table[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+    return table[value & 0xff];
+}
+
+int linearToSRgb(float value)
+{
+    // Tabulated finely enough that neighbouring entries round to the same or adjacent bytes
+    static const int Steps = 4096;
+    static const auto table = [] {
+        std::array<quint8, Steps + 1> table;
+        for (int i = 0; i <= Steps; ++i) {
+            const float v = float(i) / Steps;
+            const float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1 / 2.4f) - 0.055f;
+            table[i] = quint8(std::lround(s * 255));
+        }
+        return table;
+    }();
+    return table[int(std::lround(qBound(0.0f, value, 1.0f) * Steps))];
+}
+
+float signPow(float value, float exponent)
+{
+    return std::copysign(std::pow(std::abs(value), exponent), value);
+}
+} // namespace
+
+QImage BlurHash::decode(const QString &hash, const QSize &size, qreal punch)
+{
+    if (hash.size() < 6 || size.isEmpty()) {
+        return {};
+    }
+    const int sizeFlag = decode83(hash, 0, 1);
+    const int quantisedMaximum = decode83(hash, 1, 1);
+    if (sizeFlag < 0 || quantisedMaximum < 0) {
+        return {};
+    }
+    const int componentsX = sizeFlag % 9 + 1;
+    const int componentsY = sizeFlag / 9 + 1;
+    if (hash.size() != 4 + 2 * componentsX * componentsY) {
+        return {};
+    }
+    const float maximum = float(quantisedMaximum + 1) / 166 * float(punch);
+
+    // Colour of every component, the average colour first
+    QVector<std::array<float, 3>> colors(componentsX * componentsY);
+    const int average = decode83(hash, 2, 4);
+    if (average < 0) {
+        return {};
+    }
+    colors[0] = {sRgbToLinear(average >> 16), sRgbToLinear(average >> 8), sRgbToLinear(average)};
+    for (int i = 1; i < colors.size(); ++i) {
+        const int value = decode83(hash, 4 + i * 2, 2);
+        if (value < 0) {
+            return {};
+        }
+        colors[i] = {signPow((value / (19 * 19) - 9) / 9.0f, 2) * maximum,
+                     signPow((value / 19 % 19 - 9) / 9.0f, 2) * maximum,
+                     signPow((value % 19 - 9) / 9.0f, 2) * maximum};
+    }
+
+    // The cosines only depend on one coordinate each
+    const int width = size.width();
+    const int height = size.height();
+    QVector<float> cosinesX(width * componentsX);
+    for (int x = 0; x < width; ++x) {
+        for (int i = 0; i < componentsX; ++i) {
+            cosinesX[x * componentsX + i] = std::cos(float(M_PI) * x * i / width);
+        }
+    }
+    QVector<float> cosinesY(height * componentsY);
+    for (int y = 0; y < height; ++y) {
+        for (int j = 0; j < componentsY; ++j) {
+            cosinesY[y * componentsY + j] = std::cos(float(M_PI) * y * j / height);
+        }
+    }
+
+    QImage image(size, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+        auto line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            float r = 0;
+            float g = 0;
+            float b = 0;
+            for (int j = 0; j < componentsY; ++j) {
+                for (int i = 0; i < componentsX; ++i) {
+                    const float basis = cosinesX[x * componentsX + i] * cosinesY[y * componentsY + j];
+                    const auto &color = colors[j * componentsX + i];
+                    r += color[0] * basis;
+                    g += color[1] * basis;
+                    b += color[2] * basis;
+                }
+            }
+            line[x] = qRgb(linearToSRgb(r), linearToSRgb(g), linearToSRgb(b));
+        }
+    }
+    return image;
+}
@@ -0,0 +1,23 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/// Decoder for BlurHash, the compact image placeholders that clients send
+/// in the xyz.amorgan.blurhash field of image and video info.
+///
+/// See https://github.com/woltapp/blurhash for the format. The cosine and
+/// colour conversions are tabulated, so decoding a placeholder of a few
+/// dozen pixels takes microseconds.
+class BlurHash
+{
+public:
+    /// A null image if the hash is invalid
+    [[nodiscard]] static QImage decode(const QString &hash, const QSize &size, qreal punch = 1.0);
+};
@@ -0,0 +1,30 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "blurhashimageprovider.h"
+
+#include <QUrl>
+
+#include "blurhash.h"
+
+static const int PlaceholderSize = 32;
+
+BlurHashImageProvider::BlurHashImageProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image)
+{
+}
+
+QImage BlurHashImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    QSize placeholderSize(PlaceholderSize, PlaceholderSize);
+    if (!requestedSize.isEmpty()) {
+        placeholderSize = requestedSize.scaled(placeholderSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    }
+    const auto image = BlurHash::decode(QUrl::fromPercentEncoding(id.toUtf8()), placeholderSize);
+    if (size) {
+        *size = image.size();
+    }
+    return image;
+}
@@ -0,0 +1,20 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QQuickImageProvider>
+
+/// Renders BlurHash placeholders, as in image://blurhash/<percent-encoded hash>.
+///
+/// Placeholders are rendered at a tiny resolution with the aspect ratio of the
+/// requested size and left to the Image to scale up, which blurs them further.
+class BlurHashImageProvider : public QQuickImageProvider
+{
+public:
+    BlurHashImageProvider();
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
+};
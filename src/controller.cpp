@@ -6,13 +6,6 @@
  */
 #include "controller.h"
 
-#ifndef Q_OS_ANDROID
-#include <qt5keychain/keychain.h>
-#else
-#include <KConfig>
-#include <KConfigGroup>
-#endif
-
 #include <KLocalizedString>
 
 #include <QClipboard>
@@ -31,8 +24,10 @@
 #include <QtGui/QPixmap>
 #include <QtNetwork/QAuthenticator>
 #include <QtNetwork/QNetworkReply>
+#include <algorithm>
 #include <utility>
 
+#include "accesstokenstore.h"
 #include "csapi/account-data.h"
 #include "csapi/content-repo.h"
 #include "csapi/joining.h"
@@ -45,7 +40,11 @@
 #include "neochatroom.h"
 #include "neochatuser.h"
 #include "neochatconfig.h"
+#include "readmarkerqueue.h"
 #include "settings.h"
+#include "statehydrator.h"
+#include "statepersister.h"
+#include "syncscheduler.h"
 #include "utils.h"
 #include <KStandardShortcut>
 
@@ -53,9 +52,13 @@
 #include "trayicon.h"
 #endif
 
+// How long the accounts get to connect on startup before the UI is shown anyway
+static const int LoginTimeout = 20000;
+
 Controller::Controller(QObject *parent)
     : QObject(parent)
 {
+    m_startupTimer.start();
     QApplication::setQuitOnLastWindowClosed(false);
 
     Connection::setRoomType<NeoChatRoom>();
@@ -66,7 +69,20 @@ Controller::Controller(QObject *parent)
     connect(trayIcon, &TrayIcon::showWindow, this, &Controller::showWindow);
     trayIcon->setIconSource("org.kde.neochat");
     trayIcon->setIsOnline(true);
+    connect(this, &Controller::unreadCountChanged, trayIcon, [=] {
+        trayIcon->setNotificationCount(m_notificationCount, m_highlightCount);
+    });
+#endif
+
+#ifndef Q_OS_ANDROID
+    m_accessTokens = new AccessTokenStore(new KeychainSecretStore, this);
+#else
+    m_accessTokens = new AccessTokenStore(new KConfigSecretStore, this);
 #endif
+    connect(m_accessTokens, &AccessTokenStore::accessTokenLoaded, this, &Controller::connectAccount);
+    connect(m_accessTokens, &AccessTokenStore::errorOccured, this, &Controller::errorOccured);
+
+    m_readMarkers = new ReadMarkerQueue(this);
 
     QTimer::singleShot(0, this, [=] {
         invokeLogin();
@@ -76,8 +92,12 @@ Controller::Controller(QObject *parent)
 Controller::~Controller()
 {
     for (auto c : qAsConst(m_connections)) {
-        c->stopSync();
-        c->saveState();
+        if (auto scheduler = m_schedulers.value(c)) {
+            scheduler->stop();
+        }
+        if (auto persister = m_persisters.value(c)) {
+            persister->flushAndWait();
+        }
     }
 }
 
@@ -87,13 +107,6 @@ Controller &Controller::instance()
     return _instance;
 }
 
-inline QString accessTokenFileName(const AccountSettings &account)
-{
-    QString fileName = account.userId();
-    fileName.replace(':', '_');
-    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + '/' + fileName;
-}
-
 void Controller::loginWithCredentials(const QString &serverAddr, const QString &user, const QString &pass, QString deviceName)
 {
     if (user.isEmpty() || pass.isEmpty()) {
@@ -119,9 +132,7 @@ void Controller::loginWithCredentials(const QString &serverAddr, const QString &
             account.setHomeserver(conn->homeserver());
             account.setDeviceId(conn->deviceId());
             account.setDeviceName(deviceName);
-            if (!saveAccessTokenToKeyChain(account, conn->accessToken())) {
-                qWarning() << "Couldn't save access token";
-            }
+            m_accessTokens->saveAccessToken(account.userId(), conn->accessToken());
             account.sync();
             addConnection(conn);
             setActiveConnection(conn);
@@ -159,9 +170,7 @@ void Controller::loginWithAccessToken(const QString &serverAddr, const QString &
         account.setHomeserver(conn->homeserver());
         account.setDeviceId(conn->deviceId());
         account.setDeviceName(deviceName);
-        if (!saveAccessTokenToKeyChain(account, conn->accessToken())) {
-            qWarning() << "Couldn't save access token";
-        }
+        m_accessTokens->saveAccessToken(account.userId(), conn->accessToken());
         account.sync();
         addConnection(conn);
         setActiveConnection(conn);
@@ -180,22 +189,11 @@ void Controller::logout(Connection *conn, bool serverSideLogout)
     }
 
     SettingsGroup("Accounts").remove(conn->userId());
-    QFile(accessTokenFileName(AccountSettings(conn->userId()))).remove();
+    m_accessTokens->deleteAccessToken(conn->userId());
 
-#ifndef Q_OS_ANDROID
-    QKeychain::DeletePasswordJob job(qAppName());
-    job.setAutoDelete(true);
-    job.setKey(conn->userId());
-    QEventLoop loop;
-    QKeychain::DeletePasswordJob::connect(&job, &QKeychain::Job::finished, &loop, &QEventLoop::quit);
-    job.start();
-    loop.exec();
-#else
-    KConfig config("neochat_tokens");
-    KConfigGroup tokensGroup(&config, "Tokens");
-    tokensGroup.deleteEntry(conn->userId());
-#endif
-    conn->stopSync();
+    if (auto scheduler = m_schedulers.value(conn)) {
+        scheduler->stop();
+    }
     Q_EMIT conn->stateChanged();
     Q_EMIT conn->loggedOut();
     if (!m_connections.isEmpty()) {
@@ -220,13 +218,16 @@ void Controller::addConnection(Connection *c)
 
     c->setLazyLoading(true);
 
+    // Created before the connection is announced so that models can follow
+    // its syncs from the start; it is started in startSync()
+    m_schedulers[c] = new SyncScheduler(c);
+
     connect(c, &Connection::syncDone, this, [=] {
         setBusy(false);
 
         Q_EMIT syncDone();
 
-        c->sync(30000);
-        c->saveState();
+        m_persisters[c]->flush();
     });
     connect(c, &Connection::loggedOut, this, [=] {
         dropConnection(c);
@@ -234,15 +235,48 @@ void Controller::addConnection(Connection *c)
 
     setBusy(true);
 
-    c->sync();
+    // A sync has to be applied on top of the complete cached state
+    auto hydrator = c->findChild<StateHydrator *>();
+    if (hydrator && !hydrator->isFinished()) {
+        connect(hydrator, &StateHydrator::finished, this, [=] {
+            startSync(c);
+        });
+    } else {
+        startSync(c);
+    }
 
     Q_EMIT connectionAdded(c);
 }
 
+void Controller::startSync(Connection *c)
+{
+    // Only created now so that loading the cached state doesn't mark every room dirty
+    m_persisters[c] = new StatePersister(c);
+
+    auto scheduler = m_schedulers[c];
+    // Rooms show up while an initial sync is applied; no need to wait for its end
+    connect(scheduler, &SyncScheduler::initialSyncProgress, this, [=] {
+        if (scheduler->initialSyncRooms() > 0) {
+            setBusy(false);
+        }
+    });
+    scheduler->start();
+    if (c == m_connection) {
+        Q_EMIT syncSchedulerChanged();
+    }
+}
+
+SyncScheduler *Controller::syncScheduler() const
+{
+    return m_schedulers.value(m_connection);
+}
+
 void Controller::dropConnection(Connection *c)
 {
     Q_ASSERT_X(c, __FUNCTION__, "Attempt to drop a null connection");
     m_connections.removeOne(c);
+    m_persisters.remove(c);
+    m_schedulers.remove(c);
 
     Q_EMIT connectionDropped(c);
     c->deleteLater();
@@ -254,143 +288,111 @@ void Controller::invokeLogin()
     for (const auto &accountId : accounts) {
         AccountSettings account {accountId};
         if (!account.homeserver().isEmpty()) {
-            auto accessToken = loadAccessTokenFromKeyChain(account);
-
-            auto c = new Connection(account.homeserver(), this);
-            connect(c, &Connection::connected, this, [=] {
-                c->loadState();
-                addConnection(c);
-            });
-            connect(c, &Connection::loginError, this, [=](const QString &error, const QString &) {
-                if (error == "Unrecognised access token") {
-                    Q_EMIT errorOccured(i18n("Login Failed"), i18n("Access Token invalid or revoked"));
-                    logout(c, false);
-                } else {
-                    Q_EMIT errorOccured(i18n("Login Failed"), error);
-                    logout(c, true);
-                }
-            });
-            connect(c, &Connection::networkError, this, [=](const QString &error, const QString &, int, int) {
-                Q_EMIT errorOccured("Network Error", error);
-            });
-            c->connectWithToken(account.userId(), accessToken, account.deviceId());
+            m_pendingAccounts += account.userId();
         }
     }
 
-    if (!m_connections.isEmpty()) {
-        const QString id = NeoChatConfig::self()->activeConnection();
-        for (auto *connection : qAsConst(m_connections)) {
-            if (connection->userId() == id) {
-                setActiveConnection(connection);
-                Q_EMIT initiated();
-                return;
-            }
-        }
-        setActiveConnection(m_connections[0]);
+    if (m_pendingAccounts.isEmpty()) {
+        m_initiated = true;
+        Q_EMIT initiated();
+        return;
     }
-    Q_EMIT initiated();
-}
-
-QByteArray Controller::loadAccessTokenFromFile(const AccountSettings &account)
-{
-    QFile accountTokenFile {accessTokenFileName(account)};
-    if (accountTokenFile.open(QFile::ReadOnly)) {
-        if (accountTokenFile.size() < 1024) {
-            return accountTokenFile.readAll();
-        }
 
-        qWarning() << "File" << accountTokenFile.fileName() << "is" << accountTokenFile.size() << "bytes long - too long for a token, ignoring it.";
+    // All tokens are requested at once, each account is connected as soon as its token arrives
+    const auto pendingAccounts = m_pendingAccounts;
+    for (const auto &userId : pendingAccounts) {
+        m_accessTokens->loadAccessToken(userId);
     }
-    qWarning() << "Could not open access token file" << accountTokenFile.fileName();
 
-    return {};
+    // Don't keep the loading page up for an account that neither connects nor fails;
+    // it is still added once it connects.
+    QTimer::singleShot(LoginTimeout, this, [this] {
+        if (!m_initiated) {
+            qWarning() << "Startup: accounts not connected after" << LoginTimeout << "ms:" << m_pendingAccounts;
+            completeLogin();
+        }
+    });
 }
 
-QByteArray Controller::loadAccessTokenFromKeyChain(const AccountSettings &account)
+void Controller::connectAccount(const QString &userId, const QByteArray &accessToken)
 {
-#ifndef Q_OS_ANDROID
-    qDebug() << "Read the access token from the keychain for " << account.userId();
-    QKeychain::ReadPasswordJob job(qAppName());
-    job.setAutoDelete(false);
-    job.setKey(account.userId());
-    QEventLoop loop;
-    QKeychain::ReadPasswordJob::connect(&job, &QKeychain::Job::finished, &loop, &QEventLoop::quit);
-    job.start();
-    loop.exec();
-
-    if (job.error() == QKeychain::Error::NoError) {
-        return job.binaryData();
+    if (!m_pendingAccounts.contains(userId)) {
+        return;
     }
-
-    qWarning() << "Could not read the access token from the keychain: " << qPrintable(job.errorString());
-    // no access token from the keychain, try token file
-    auto accessToken = loadAccessTokenFromFile(account);
-    if (job.error() == QKeychain::Error::EntryNotFound) {
-        if (!accessToken.isEmpty()) {
-            qDebug() << "Migrating the access token from file to the keychain for " << account.userId();
-            bool removed = false;
-            bool saved = saveAccessTokenToKeyChain(account, accessToken);
-            if (saved) {
-                QFile accountTokenFile {accessTokenFileName(account)};
-                removed = accountTokenFile.remove();
-            }
-            if (!(saved && removed)) {
-                qDebug() << "Migrating the access token from the file to the keychain "
-                            "failed";
-            }
-        }
+    if (accessToken.isEmpty()) {
+        qWarning() << "No access token found for" << userId;
+        finishAccountLogin(userId);
+        return;
     }
-
-    return accessToken;
-#else
-    qDebug() << "Saving access token to KConfig";
-    KConfig config("neochat_tokens");
-    KConfigGroup tokensGroup(&config, "Tokens");
-    QString token = tokensGroup.readEntry(account.userId(), QString());
-    return token.toLatin1();
-#endif
+    AccountSettings account {userId};
+
+    auto c = new Connection(account.homeserver(), this);
+    connect(c, &Connection::connected, this, [=] {
+        auto hydrator = new StateHydrator(c);
+        if (!hydrator->start()) {
+            delete hydrator;
+            c->loadState();
+        }
+        addConnection(c);
+        finishAccountLogin(userId);
+    });
+    connect(c, &Connection::loginError, this, [=](const QString &error, const QString &) {
+        if (error == "Unrecognised access token") {
+            Q_EMIT errorOccured(i18n("Login Failed"), i18n("Access Token invalid or revoked"));
+            logout(c, false);
+        } else {
+            Q_EMIT errorOccured(i18n("Login Failed"), error);
+            logout(c, true);
+        }
+        finishAccountLogin(userId);
+    });
+    connect(c, &Connection::resolveError, this, [=](const QString &error) {
+        Q_EMIT errorOccured(i18n("Network Error"), error);
+        finishAccountLogin(userId);
+    });
+    connect(c, &Connection::networkError, this, [=](const QString &error, const QString &, int, int) {
+        Q_EMIT errorOccured("Network Error", error);
+    });
+    c->connectWithToken(account.userId(), accessToken, account.deviceId());
 }
 
-bool Controller::saveAccessTokenToFile(const AccountSettings &account, const QByteArray &accessToken)
+void Controller::finishAccountLogin(const QString &userId)
 {
-    // (Re-)Make a dedicated file for access_token.
-    QFile accountTokenFile {accessTokenFileName(account)};
-    accountTokenFile.remove(); // Just in case
-
-    auto fileDir = QFileInfo(accountTokenFile).dir();
-    if (!((fileDir.exists() || fileDir.mkpath(".")) && accountTokenFile.open(QFile::WriteOnly))) {
-        Q_EMIT errorOccured("I/O Denied", "Cannot save access token.");
-    } else {
-        accountTokenFile.write(accessToken);
-        return true;
+    if (!m_pendingAccounts.removeOne(userId)) {
+        return;
+    }
+    Q_EMIT accountLoginFinished(userId);
+    if (m_pendingAccounts.isEmpty()) {
+        qDebug() << "Startup: accounts connected after" << m_startupTimer.elapsed() << "ms";
+    }
+    if (m_pendingAccounts.isEmpty() || m_initiated) {
+        completeLogin();
     }
-    return false;
 }
 
-bool Controller::saveAccessTokenToKeyChain(const AccountSettings &account, const QByteArray &accessToken)
+void Controller::completeLogin()
 {
-#ifndef Q_OS_ANDROID
-    qDebug() << "Save the access token to the keychain for " << account.userId();
-    QKeychain::WritePasswordJob job(qAppName());
-    job.setAutoDelete(false);
-    job.setKey(account.userId());
-    job.setBinaryData(accessToken);
-    QEventLoop loop;
-    QKeychain::WritePasswordJob::connect(&job, &QKeychain::Job::finished, &loop, &QEventLoop::quit);
-    job.start();
-    loop.exec();
-
-    if (job.error()) {
-        qWarning() << "Could not save access token to the keychain: " << qPrintable(job.errorString());
-        return saveAccessTokenToFile(account, accessToken);
+    if (m_initiated) {
+        // An account connected after the timeout; make sure one is active
+        if (!m_connection && !m_connections.isEmpty()) {
+            setActiveConnection(m_connections[0]);
+        }
+        return;
     }
+    m_initiated = true;
 
-#else
-    KConfig config("neochat_tokens");
-    KConfigGroup tokensGroup(&config, "Tokens");
-    tokensGroup.writeEntry(account.userId(), accessToken);
-#endif
-    return true;
+    if (!m_connections.isEmpty()) {
+        const QString id = NeoChatConfig::self()->activeConnection();
+        for (auto *connection : qAsConst(m_connections)) {
+            if (connection->userId() == id) {
+                setActiveConnection(connection);
+                Q_EMIT initiated();
+                return;
+            }
+        }
+        setActiveConnection(m_connections[0]);
+    }
+    Q_EMIT initiated();
 }
 
 void Controller::joinRoom(Connection *c, const QString &alias)
@@ -444,10 +446,42 @@ void Controller::changeAvatar(Connection *conn, const QUrl &localFile)
 
 void Controller::markAllMessagesAsRead(Connection *conn)
 {
-    const auto rooms = conn->allRooms();
-    for (auto room : rooms) {
-        room->markAllMessagesAsRead();
+    m_readMarkers->markAllAsRead(conn);
+}
+
+ReadMarkerQueue *Controller::readMarkerQueue() const
+{
+    return m_readMarkers;
+}
+
+int Controller::notificationCount() const
+{
+    return m_notificationCount;
+}
+
+int Controller::highlightCount() const
+{
+    return m_highlightCount;
+}
+
+void Controller::setUnreadCounts(int notificationCount, int highlightCount)
+{
+    if (m_notificationCount == notificationCount && m_highlightCount == highlightCount) {
+        return;
     }
+    m_notificationCount = notificationCount;
+    m_highlightCount = highlightCount;
+    Q_EMIT unreadCountChanged();
+}
+
+void Controller::reportRoomListShown(int rooms)
+{
+    if (m_roomListShown) {
+        return;
+    }
+    m_roomListShown = true;
+    qDebug() << "Startup: room list with" << rooms << "rooms shown after" << m_startupTimer.elapsed() << "ms"
+             << (m_connections.isEmpty() ? "from the snapshot" : "from the live rooms");
 }
 
 void Controller::setAboutData(const KAboutData &aboutData)
@@ -509,6 +543,27 @@ int Controller::accountCount() const
     return m_connections.count();
 }
 
+bool Controller::isAccountConnected(const QString &userId) const
+{
+    return std::any_of(m_connections.cbegin(), m_connections.cend(), [&userId](Connection *c) {
+        return c->userId() == userId;
+    });
+}
+
+NeoChatRoom *Controller::loadRoom(const QString &userId, const QString &roomId)
+{
+    for (auto c : qAsConst(m_connections)) {
+        if (c->userId() != userId) {
+            continue;
+        }
+        if (auto hydrator = c->findChild<StateHydrator *>(); hydrator && !hydrator->isFinished()) {
+            hydrator->hydrate(roomId);
+        }
+        return static_cast<NeoChatRoom *>(c->room(roomId, JoinState::Join | JoinState::Invite));
+    }
+    return nullptr;
+}
+
 bool Controller::quitOnLastWindowClosed()
 {
     return QApplication::quitOnLastWindowClosed();
@@ -557,6 +612,7 @@ void Controller::setActiveConnection(Connection *connection)
     }
     NeoChatConfig::self()->save();
     Q_EMIT activeConnectionChanged();
+    Q_EMIT syncSchedulerChanged();
 }
 
 QList<QKeySequence> Controller::preferencesShortcuts() const
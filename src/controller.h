@@ -7,6 +7,7 @@
 #define CONTROLLER_H
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QMediaPlayer>
 #include <QMenu>
 #include <QObject>
@@ -20,7 +21,11 @@ class QKeySequences;
 #include "settings.h"
 #include "user.h"
 
+class AccessTokenStore;
 class NeoChatRoom;
+class ReadMarkerQueue;
+class StatePersister;
+class SyncScheduler;
 
 using namespace Quotient;
 
@@ -31,6 +36,13 @@ class Controller : public QObject
     Q_PROPERTY(bool quitOnLastWindowClosed READ quitOnLastWindowClosed WRITE setQuitOnLastWindowClosed NOTIFY quitOnLastWindowClosedChanged)
     Q_PROPERTY(Connection *activeConnection READ activeConnection WRITE setActiveConnection NOTIFY activeConnectionChanged)
     Q_PROPERTY(bool busy READ busy WRITE setBusy NOTIFY busyChanged)
+    /// The sync scheduler of the active connection
+    Q_PROPERTY(SyncScheduler *syncScheduler READ syncScheduler NOTIFY syncSchedulerChanged)
+    /// Aggregated counters of the room list, see setUnreadCounts()
+    Q_PROPERTY(int notificationCount READ notificationCount NOTIFY unreadCountChanged)
+    Q_PROPERTY(int highlightCount READ highlightCount NOTIFY unreadCountChanged)
+    /// Progress of markAllMessagesAsRead()
+    Q_PROPERTY(ReadMarkerQueue *readMarkerQueue READ readMarkerQueue CONSTANT)
     Q_PROPERTY(KAboutData aboutData READ aboutData WRITE setAboutData NOTIFY aboutDataChanged)
 
     /// Get the list of shortcuts activating the preferences page
@@ -54,6 +66,12 @@ public:
 
     [[nodiscard]] int accountCount() const;
 
+    /// The room of a connected account, loading its cached state first if
+    /// the StateHydrator of the account didn't get to it yet. Null if the
+    /// account isn't connected or doesn't know the room.
+    Q_INVOKABLE NeoChatRoom *loadRoom(const QString &userId, const QString &roomId);
+    Q_INVOKABLE [[nodiscard]] bool isAccountConnected(const QString &userId) const;
+
     [[nodiscard]] QList<QKeySequence> preferencesShortcuts() const;
 
     [[nodiscard]] static bool quitOnLastWindowClosed();
@@ -62,6 +80,16 @@ public:
     [[nodiscard]] bool busy() const;
     void setBusy(bool busy);
 
+    [[nodiscard]] SyncScheduler *syncScheduler() const;
+    [[nodiscard]] ReadMarkerQueue *readMarkerQueue() const;
+
+    [[nodiscard]] int notificationCount() const;
+    [[nodiscard]] int highlightCount() const;
+    /// Called with the counters of the room list whenever they change
+    Q_INVOKABLE void setUnreadCounts(int notificationCount, int highlightCount);
+    /// Called by the room list once it first shows rooms, to log the startup time
+    Q_INVOKABLE void reportRoomListShown(int rooms);
+
     void setAboutData(const KAboutData &aboutData);
     [[nodiscard]] KAboutData aboutData() const;
 
@@ -77,16 +105,26 @@ private:
     ~Controller() override;
 
     QVector<Connection *> m_connections;
+    QHash<Connection *, StatePersister *> m_persisters;
+    QHash<Connection *, SyncScheduler *> m_schedulers;
     QPointer<Connection> m_connection;
     bool m_busy = false;
-
-    static QByteArray loadAccessTokenFromFile(const AccountSettings &account);
-    QByteArray loadAccessTokenFromKeyChain(const AccountSettings &account);
-
-    bool saveAccessTokenToFile(const AccountSettings &account, const QByteArray &accessToken);
-    bool saveAccessTokenToKeyChain(const AccountSettings &account, const QByteArray &accessToken);
+    int m_notificationCount = 0;
+    int m_highlightCount = 0;
+
+    AccessTokenStore *m_accessTokens;
+    ReadMarkerQueue *m_readMarkers;
+    QStringList m_pendingAccounts;
+    bool m_initiated = false;
+    QElapsedTimer m_startupTimer;
+    bool m_roomListShown = false;
+
+    void connectAccount(const QString &userId, const QByteArray &accessToken);
+    void finishAccountLogin(const QString &userId);
+    void completeLogin();
     void loadSettings();
     void saveSettings() const;
+    void startSync(Connection *c);
 
     KAboutData m_aboutData;
 
@@ -95,6 +133,7 @@ private Q_SLOTS:
 
 Q_SIGNALS:
     void busyChanged();
+    void syncSchedulerChanged();
     /// Error occured because of user inputs
     void errorOccured(QString error, QString detail);
 
@@ -104,6 +143,8 @@ Q_SIGNALS:
     void connectionAdded(Quotient::Connection *_t1);
     void connectionDropped(Quotient::Connection *_t1);
     void initiated();
+    /// An account connected at startup has connected or failed to, possibly after initiated()
+    void accountLoginFinished(const QString &userId);
     void notificationClicked(const QString &_t1, const QString &_t2);
     void quitOnLastWindowClosedChanged();
     void unreadCountChanged();
@@ -120,7 +161,7 @@ public Q_SLOTS:
     void createDirectChat(Quotient::Connection *c, const QString &userID);
     static void playAudio(const QUrl &localFile);
     void changeAvatar(Quotient::Connection *conn, const QUrl &localFile);
-    static void markAllMessagesAsRead(Quotient::Connection *conn);
+    void markAllMessagesAsRead(Quotient::Connection *conn);
 };
 
 // TODO libQuotient 0.7: Drop
@@ -0,0 +1,81 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "imagecache.h"
+
+#include <QMutexLocker>
+
+static const qint64 DefaultMaxBytes = 64 * 1024 * 1024;
+
+ImageCache::ImageCache()
+{
+    setMaxBytes(DefaultMaxBytes);
+}
+
+ImageCache &ImageCache::instance()
+{
+    static ImageCache _instance;
+    return _instance;
+}
+
+QString ImageCache::key(const QString &mediaId, const QSize &size)
+{
+    return QStringLiteral("%1@%2x%3").arg(mediaId, QString::number(size.width()), QString::number(size.height()));
+}
+
+QImage ImageCache::find(const QString &mediaId, const QSize &size)
+{
+    QMutexLocker _(&m_mutex);
+    // Looking the image up also makes it the most recently used one
+    const auto image = m_images.object(key(mediaId, size));
+    if (!image) {
+        m_misses.fetchAndAddRelaxed(1);
+        return {};
+    }
+    m_hits.fetchAndAddRelaxed(1);
+    return *image;
+}
+
+void ImageCache::insert(const QString &mediaId, const QSize &size, const QImage &image)
+{
+    if (image.isNull()) {
+        return;
+    }
+    const int cost = int(qMax<qint64>(1, image.sizeInBytes() / 1024));
+    QMutexLocker _(&m_mutex);
+    // Images larger than the whole cache are not kept
+    m_images.insert(key(mediaId, size), new QImage(image), cost);
+}
+
+void ImageCache::clear()
+{
+    QMutexLocker _(&m_mutex);
+    m_images.clear();
+}
+
+qint64 ImageCache::maxBytes() const
+{
+    QMutexLocker _(&m_mutex);
+    return qint64(m_images.maxCost()) * 1024;
+}
+
+void ImageCache::setMaxBytes(qint64 maxBytes)
+{
+    QMutexLocker _(&m_mutex);
+    m_images.setMaxCost(int(maxBytes / 1024));
+}
+
+qint64 ImageCache::residentBytes() const
+{
+    QMutexLocker _(&m_mutex);
+    return qint64(m_images.totalCost()) * 1024;
+}
+
+qreal ImageCache::hitRate() const
+{
+    const auto hits = m_hits.loadRelaxed();
+    const auto lookups = hits + m_misses.loadRelaxed();
+    return lookups > 0 ? qreal(hits) / lookups : 0;
+}
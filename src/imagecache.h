@@ -0,0 +1,51 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QAtomicInteger>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+
+/// Decoded images of the image provider, shared by all requests.
+///
+/// A least recently used cache of QImages keyed by media ID and requested
+/// size, limited by the bytes the images take up in memory. It is checked
+/// before the disk cache, so an avatar shown many times only gets loaded
+/// and decoded once. It is used from the threads of the image provider,
+/// hence every access is serialized.
+class ImageCache
+{
+public:
+    static ImageCache &instance();
+
+    /// A null image if it isn't cached
+    [[nodiscard]] QImage find(const QString &mediaId, const QSize &size);
+    void insert(const QString &mediaId, const QSize &size, const QImage &image);
+    void clear();
+
+    [[nodiscard]] qint64 maxBytes() const;
+    /// Least recently used images are dropped until the cache fits
+    void setMaxBytes(qint64 maxBytes);
+
+    /// Bytes taken up by the cached images
+    [[nodiscard]] qint64 residentBytes() const;
+    /// Share of lookups that found their image, between 0 and 1
+    [[nodiscard]] qreal hitRate() const;
+
+private:
+    ImageCache();
+
+    [[nodiscard]] static QString key(const QString &mediaId, const QSize &size);
+
+    mutable QMutex m_mutex;
+    /// Costs are in KiB, which keeps them within an int
+    QCache<QString, QImage> m_images;
+    QAtomicInteger<quint64> m_hits;
+    QAtomicInteger<quint64> m_misses;
+};
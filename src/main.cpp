@@ -22,7 +22,9 @@
 
 #include "neochat-version.h"
 
+#include "accountfiltermodel.h"
 #include "accountlistmodel.h"
+#include "blurhashimageprovider.h"
 #include "chatdocumenthandler.h"
 #include "clipboard.h"
 #include "controller.h"
@@ -30,15 +32,23 @@
 #include "csapi/leaving.h"
 #include "emojimodel.h"
 #include "matriximageprovider.h"
+#include "mediacachemanager.h"
+#include "mediajobscheduler.h"
+#include "mergedroomlistmodel.h"
 #include "messageeventmodel.h"
 #include "neochatconfig.h"
 #include "neochatroom.h"
 #include "neochatuser.h"
 #include "notificationsmanager.h"
 #include "publicroomlistmodel.h"
+#include "readmarkerqueue.h"
 #include "room.h"
 #include "roomlistmodel.h"
+#include "roomsearchmodel.h"
+#include "roomtreemodel.h"
 #include "sortfilterroomlistmodel.h"
+#include "syncscheduler.h"
+#include "thumbnailprefetcher.h"
 #include "userdirectorylistmodel.h"
 #include "userlistmodel.h"
 #include "devicesmodel.h"
@@ -93,6 +103,8 @@ int main(int argc, char *argv[])
     qmlRegisterSingletonInstance("org.kde.neochat", 1, 0, "Controller", &Controller::instance());
     qmlRegisterSingletonInstance("org.kde.neochat", 1, 0, "Clipboard", &clipboard);
     qmlRegisterSingletonInstance("org.kde.neochat", 1, 0, "Config", config);
+    qmlRegisterSingletonInstance("org.kde.neochat", 1, 0, "MediaCacheManager", &MediaCacheManager::instance());
+    qmlRegisterSingletonInstance("org.kde.neochat", 1, 0, "MediaJobScheduler", &MediaJobScheduler::instance());
     qmlRegisterType<AccountListModel>("org.kde.neochat", 1, 0, "AccountListModel");
     qmlRegisterType<ChatDocumentHandler>("org.kde.neochat", 1, 0, "ChatDocumentHandler");
     qmlRegisterType<RoomListModel>("org.kde.neochat", 1, 0, "RoomListModel");
@@ -102,10 +114,17 @@ int main(int argc, char *argv[])
     qmlRegisterType<UserDirectoryListModel>("org.kde.neochat", 1, 0, "UserDirectoryListModel");
     qmlRegisterType<EmojiModel>("org.kde.neochat", 1, 0, "EmojiModel");
     qmlRegisterType<SortFilterRoomListModel>("org.kde.neochat", 1, 0, "SortFilterRoomListModel");
+    qmlRegisterType<RoomSearchModel>("org.kde.neochat", 1, 0, "RoomSearchModel");
+    qmlRegisterType<RoomTreeModel>("org.kde.neochat", 1, 0, "RoomTreeModel");
+    qmlRegisterType<MergedRoomListModel>("org.kde.neochat", 1, 0, "MergedRoomListModel");
+    qmlRegisterType<AccountFilterModel>("org.kde.neochat", 1, 0, "AccountFilterModel");
     qmlRegisterType<DevicesModel>("org.kde.neochat", 1, 0, "DevicesModel");
+    qmlRegisterType<ThumbnailPrefetcher>("org.kde.neochat", 1, 0, "ThumbnailPrefetcher");
     qmlRegisterUncreatableType<RoomMessageEvent>("org.kde.neochat", 1, 0, "RoomMessageEvent", "ENUM");
     qmlRegisterUncreatableType<RoomType>("org.kde.neochat", 1, 0, "RoomType", "ENUM");
     qmlRegisterUncreatableType<UserType>("org.kde.neochat", 1, 0, "UserType", "ENUM");
+    qmlRegisterUncreatableType<SyncScheduler>("org.kde.neochat", 1, 0, "SyncScheduler", "Created by Controller");
+    qmlRegisterUncreatableType<ReadMarkerQueue>("org.kde.neochat", 1, 0, "ReadMarkerQueue", "Created by Controller");
 
     qRegisterMetaType<User *>("User*");
     qRegisterMetaType<User *>("const User*");
@@ -135,6 +154,7 @@ int main(int argc, char *argv[])
 
     engine.addImportPath("qrc:/imports");
     engine.addImageProvider(QLatin1String("mxc"), new MatrixImageProvider);
+    engine.addImageProvider(QLatin1String("blurhash"), new BlurHashImageProvider);
 
     engine.load(QUrl(QStringLiteral("qrc:/qml/main.qml")));
     if (engine.rootObjects().isEmpty()) {
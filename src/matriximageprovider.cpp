@@ -6,110 +6,484 @@
  */
 #include "matriximageprovider.h"
 
+#include <QBuffer>
+#include <QDataStream>
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
-#include <QStandardPaths>
+#include <QImageReader>
+#include <QSaveFile>
 #include <QThread>
+#include <QUrl>
 
 #include <KLocalizedString>
 
 #include "controller.h"
+#include "imagecache.h"
+#include "mediacachemanager.h"
+#include "mediajobscheduler.h"
+#include "thumbnailjob.h"
 
 using Quotient::BaseJob;
 
-ThumbnailResponse::ThumbnailResponse(QString id, QSize size)
-    : mediaId(std::move(id))
-    , requestedSize(size)
-    , localFile(QStringLiteral("%1/image_provider/%2-%3x%4.png").arg(QStandardPaths::writableLocation(QStandardPaths::CacheLocation), mediaId, QString::number(requestedSize.width()), QString::number(requestedSize.height())))
-    , errorStr("Image request hasn't started")
+// Thumbnails are stored as sent by the server, after a header with their MIME type
+static const quint32 ThumbnailMagic = 0x4e435448; // "NCTH"
+static const quint32 ThumbnailVersion = 1;
+
+static bool writeThumbnail(const QString &fileName, const QByteArray &mimeType, const QByteArray &bytes)
+{
+    const auto dir = QFileInfo(fileName).dir();
+    if (!dir.exists() && !dir.mkpath(QStringLiteral("."))) {
+        return false;
+    }
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << ThumbnailMagic << ThumbnailVersion << mimeType;
+    return file.write(bytes) == bytes.size() && file.commit();
+}
+
+/// Opens the file and reads its header, leaving it at the image
+static bool openThumbnail(QFile &file, QByteArray *mimeType)
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    quint32 magic;
+    quint32 version;
+    stream >> magic >> version >> *mimeType;
+    return stream.status() == QDataStream::Ok && magic == ThumbnailMagic && version == ThumbnailVersion;
+}
+
+static QImage decodeThumbnail(QIODevice *device, const QByteArray &mimeType, const QSize &requestedSize)
+{
+    QImageReader reader(device, QImageReader::imageFormatsForMimeType(mimeType).value(0));
+    reader.setDecideFormatFromContent(true);
+    reader.setAutoTransform(true);
+    // Larger images are decoded at the requested size right away
+    const auto size = reader.size();
+    if (size.isValid() && (size.width() > requestedSize.width() || size.height() > requestedSize.height())) {
+        reader.setScaledSize(size.scaled(requestedSize, Qt::KeepAspectRatio));
+    }
+    return reader.read();
+}
+
+// The sizes servers generate thumbnails in ahead of time, smallest first
+static const QVector<QSize> SizeClasses {{32, 32}, {96, 96}, {320, 240}, {640, 480}, {800, 600}};
+// Larger sizes are rounded up to a multiple of this
+static const int LargeSizeStep = 512;
+
+// Requests up to this size class are taken to be avatars
+static const int AvatarSizeLimit = 96;
+
+/// The smallest size class that fits the size
+static QSize sizeClass(const QSize &size)
+{
+    for (const auto &sizeClass : SizeClasses) {
+        if (sizeClass.width() >= size.width() && sizeClass.height() >= size.height()) {
+            return sizeClass;
+        }
+    }
+    const auto roundUp = [](int length) {
+        return (length + LargeSizeStep - 1) / LargeSizeStep * LargeSizeStep;
+    };
+    return {roundUp(size.width()), roundUp(size.height())};
+}
+
+static QString cacheFile(const QString &mediaId, const QSize &size)
+{
+    return QStringLiteral("%1/%2-%3x%4").arg(MediaCacheManager::directory(), mediaId, QString::number(size.width()), QString::number(size.height()));
+}
+
+/// The account of an ID with one, as in "<account>/<server>/<media>"
+static QString accountOf(const QString &id)
+{
+    if (id.count(QLatin1Char('/')) < 2) {
+        return {};
+    }
+    return QUrl::fromPercentEncoding(id.section(QLatin1Char('/'), 0, 0).toUtf8());
+}
+
+static QString mediaIdOf(const QString &id)
 {
-    if (requestedSize.isEmpty()) {
-        requestedSize.setHeight(100);
-        requestedSize.setWidth(100);
+    if (id.count(QLatin1Char('/')) < 2) {
+        return id;
     }
+    return id.section(QLatin1Char('/'), 1);
+}
+
+ThumbnailResponse::ThumbnailResponse(const QString &id, QSize size, bool prefetch)
+    : account(accountOf(id))
+    , mediaId(mediaIdOf(id))
+    , requestedSize(size.isEmpty() ? QSize(100, 100) : size)
+    , thumbnailSize(sizeClass(requestedSize))
+    , localFile(cacheFile(mediaId, thumbnailSize))
+    // Avatars are small, images in the timeline are larger
+    , priority(prefetch ? MediaJobScheduler::Prefetch : thumbnailSize.width() <= AvatarSizeLimit ? MediaJobScheduler::VisibleAvatar : MediaJobScheduler::VisibleImage)
+    , errorStr("Image request hasn't started")
+{
     if (mediaId.count('/') != 1) {
         errorStr = i18n("Media id '%1' doesn't follow server/mediaId pattern", mediaId);
-        Q_EMIT finished();
+        finish();
         return;
     }
 
-    QImage cachedImage;
-    if (cachedImage.load(localFile)) {
+    auto &cache = ImageCache::instance();
+    QImage cachedImage = cache.find(mediaId, requestedSize);
+    if (!cachedImage.isNull()) {
         image = cachedImage;
         errorStr.clear();
-        Q_EMIT finished();
+        finish();
         return;
     }
+    // A larger thumbnail that is cached already is downscaled instead of downloading a new one
+    QStringList candidates {localFile};
+    for (const auto &larger : SizeClasses) {
+        if (larger.width() > thumbnailSize.width() && larger.height() > thumbnailSize.height()) {
+            candidates += cacheFile(mediaId, larger);
+        }
+    }
+    for (const auto &candidate : qAsConst(candidates)) {
+        QFile file(candidate);
+        QByteArray fileMimeType;
+        if (openThumbnail(file, &fileMimeType)) {
+            // Decoded once the image is asked for
+            encodedFile = candidate;
+            MediaCacheManager::instance().recordAccess(candidate);
+            errorStr.clear();
+            finish();
+            return;
+        }
+    }
 
-    if (!Controller::instance().activeConnection()) {
-        qWarning() << "Current connection is null";
+    // Execute a request on the main thread asynchronously, where it waits for its connection if needed
+    moveToThread(Controller::instance().thread());
+    QMetaObject::invokeMethod(this, &ThumbnailResponse::startRequest, Qt::QueuedConnection);
+}
+
+ThumbnailJobs::ThumbnailJobs()
+{
+    m_ioPool.setMaxThreadCount(1);
+
+    auto &controller = Controller::instance();
+    connect(&controller, &Controller::connectionAdded, this, [this](Connection *connection) {
+        scheduleWaiting(connection->userId());
+    });
+    connect(&controller, &Controller::activeConnectionChanged, this, [this] {
+        const auto connection = Controller::instance().activeConnection();
+        if (!connection) {
+            return;
+        }
+        // The requests without an account have been waiting for an active one
+        for (auto &inFlight : m_jobs) {
+            if (inFlight.account.isEmpty()) {
+                inFlight.account = connection->userId();
+            }
+        }
+        scheduleWaiting(connection->userId());
+    });
+    connect(&controller, &Controller::connectionDropped, this, [this](Connection *connection) {
+        failJobs(connection->userId(), i18n("The account has been logged out"));
+    });
+}
+
+ThumbnailJobs::~ThumbnailJobs()
+{
+    m_ioPool.waitForDone();
+}
+
+ThumbnailJobs &ThumbnailJobs::instance()
+{
+    static ThumbnailJobs _instance;
+    return _instance;
+}
+
+QString ThumbnailJobs::key(const ThumbnailResponse *response)
+{
+    return QStringLiteral("%1/%2@%3x%4").arg(response->account, response->mediaId, QString::number(response->thumbnailSize.width()), QString::number(response->thumbnailSize.height()));
+}
+
+MediaJobScheduler::Priority ThumbnailJobs::priority(const InFlight &inFlight)
+{
+    auto priority = MediaJobScheduler::BackgroundDownload;
+    for (const auto response : inFlight.waiters) {
+        priority = qMin(priority, response->priority);
+    }
+    return priority;
+}
+
+void ThumbnailJobs::attach(ThumbnailResponse *response)
+{
+    const auto responseKey = key(response);
+    response->waiting = true;
+    auto it = m_jobs.find(responseKey);
+    if (it != m_jobs.end()) {
+        // A prefetched thumbnail becomes urgent once it is shown
+        it->waiters += response;
+        MediaJobScheduler::instance().setPriority(it->ticket, priority(*it));
         return;
     }
 
-    // Execute a request on the main thread asynchronously
-    moveToThread(Controller::instance().activeConnection()->thread());
-    QMetaObject::invokeMethod(this, &ThumbnailResponse::startRequest, Qt::QueuedConnection);
+    // Media without an account is fetched by the active one
+    auto account = response->account;
+    if (account.isEmpty() && Controller::instance().activeConnection()) {
+        account = Controller::instance().activeConnection()->userId();
+    }
+    InFlight inFlight;
+    inFlight.account = account;
+    inFlight.mediaId = response->mediaId;
+    inFlight.size = response->thumbnailSize;
+    inFlight.localFile = response->localFile;
+    inFlight.waiters += response;
+    m_jobs.insert(responseKey, inFlight);
+    schedule(responseKey);
 }
 
-void ThumbnailResponse::startRequest()
+Connection *ThumbnailJobs::connection(const QString &account)
 {
-    // Runs in the main thread, not QML thread
-    Q_ASSERT(QThread::currentThread() == Controller::instance().activeConnection()->thread());
-    job = Controller::instance().activeConnection()->getThumbnail(mediaId, requestedSize);
+    if (account.isEmpty()) {
+        return nullptr;
+    }
+    const auto connections = Controller::instance().connections();
+    for (const auto connection : connections) {
+        if (connection->userId() == account) {
+            return connection;
+        }
+    }
+    return nullptr;
+}
+
+void ThumbnailJobs::schedule(const QString &key)
+{
+    auto it = m_jobs.find(key);
+    // Until the connection is there, the request waits unscheduled
+    const auto c = connection(it->account);
+    if (!c) {
+        return;
+    }
+    it->ticket = MediaJobScheduler::instance().enqueue(c->homeserver().host(), priority(*it), [this, key] {
+        startJob(key);
+    });
+}
+
+void ThumbnailJobs::scheduleWaiting(const QString &account)
+{
+    for (auto it = m_jobs.constBegin(); it != m_jobs.constEnd(); ++it) {
+        if (it->account == account && it->ticket == 0) {
+            schedule(it.key());
+        }
+    }
+}
+
+void ThumbnailJobs::startJob(const QString &key)
+{
+    // Requests leave the scheduler when they are removed, so this one is still there
+    const auto it = m_jobs.find(key);
+    Q_ASSERT(it != m_jobs.end());
+    const auto ticket = it->ticket;
+    const auto c = connection(it->account);
+    if (!c) {
+        MediaJobScheduler::instance().finish(ticket);
+        failJobs(it->account, i18n("The account has been logged out"));
+        return;
+    }
+
+    it->job = c->callApi<ThumbnailJob>(Quotient::BackgroundRequest, it->mediaId.section(QLatin1Char('/'), 0, 0), it->mediaId.section(QLatin1Char('/'), 1), it->size);
     // Connect to any possible outcome including abandonment
     // to make sure the QML thread is not left stuck forever.
-    connect(job, &BaseJob::finished, this, &ThumbnailResponse::prepareResult);
+    connect(it->job, &BaseJob::finished, this, [this, key, ticket] {
+        complete(key);
+        MediaJobScheduler::instance().finish(ticket);
+    });
+}
+
+void ThumbnailJobs::failJobs(const QString &account, const QString &error)
+{
+    QVector<ThumbnailJob *> jobs;
+    for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+        if (it->account != account) {
+            ++it;
+            continue;
+        }
+        for (auto response : qAsConst(it->waiters)) {
+            response->complete({}, {}, error);
+        }
+        if (it->job) {
+            jobs += it->job;
+        } else {
+            MediaJobScheduler::instance().cancel(it->ticket);
+        }
+        it = m_jobs.erase(it);
+    }
+    for (auto job : qAsConst(jobs)) {
+        job->abandon();
+    }
 }
 
-void ThumbnailResponse::prepareResult()
+void ThumbnailJobs::detach(ThumbnailResponse *response)
 {
+    if (!response->waiting) {
+        return;
+    }
+    response->waiting = false;
+    auto it = m_jobs.find(key(response));
+    if (it == m_jobs.end()) {
+        return;
+    }
+    it->waiters.removeOne(response);
+    if (!it->waiters.isEmpty()) {
+        MediaJobScheduler::instance().setPriority(it->ticket, priority(*it));
+        return;
+    }
+
+    // Nobody is interested in the result anymore; a queued request never reaches the network
+    const auto job = it->job;
+    const auto ticket = it->ticket;
+    m_jobs.erase(it);
+    if (job) {
+        job->abandon();
+    } else {
+        MediaJobScheduler::instance().cancel(ticket);
+    }
+}
+
+void ThumbnailJobs::complete(const QString &key)
+{
+    const auto it = m_jobs.constFind(key);
+    // Abandoned jobs have been removed already
+    if (it == m_jobs.constEnd()) {
+        return;
+    }
+    const auto inFlight = *it;
+    m_jobs.erase(it);
+
+    const auto job = inFlight.job;
     Q_ASSERT(QThread::currentThread() == job->thread());
     Q_ASSERT(job->error() != BaseJob::Pending);
+    if (job->error() != BaseJob::Success) {
+        const auto errorStr = job->errorString();
+        qWarning() << "ThumbnailResponse: no valid image for" << inFlight.waiters.first()->mediaId << "-" << errorStr;
+        for (auto response : inFlight.waiters) {
+            response->complete({}, {}, errorStr);
+        }
+        return;
+    }
+
+    // Neither decoded nor re-encoded here, the responses decode it when it is shown
+    const auto bytes = job->bytes();
+    const auto mimeType = job->mimeType();
+    m_ioPool.start([fileName = inFlight.localFile, mimeType, bytes] {
+        if (!writeThumbnail(fileName, mimeType, bytes)) {
+            qWarning() << "Unable to write thumbnail" << fileName;
+            return;
+        }
+        MediaCacheManager::instance().recordWrite(fileName, QFileInfo(fileName).size());
+    });
+    for (auto response : inFlight.waiters) {
+        response->complete(bytes, mimeType, {});
+    }
+}
+
+void ThumbnailResponse::startRequest()
+{
+    // Runs in the main thread, not QML thread
+    Q_ASSERT(QThread::currentThread() == Controller::instance().thread());
+    ThumbnailJobs::instance().attach(this);
+}
+
+void ThumbnailResponse::complete(const QByteArray &bytes, const QByteArray &mimeType, const QString &error)
+{
     {
         QWriteLocker _(&lock);
-        if (job->error() == BaseJob::Success) {
-            image = job->thumbnail();
+        encoded = bytes;
+        encodedMimeType = mimeType;
+        errorStr = error;
+        waiting = false;
+    }
+    finish();
+}
 
-            QString localPath = QFileInfo(localFile).absolutePath();
-            QDir dir;
-            if (!dir.exists(localPath)) {
-                dir.mkpath(localPath);
-            }
+void ThumbnailResponse::finish()
+{
+    done = true;
+    Q_EMIT finished();
+}
 
-            image.save(localFile);
+bool ThumbnailResponse::isFinished() const
+{
+    return done;
+}
 
-            errorStr.clear();
-        } else if (job->error() == BaseJob::Abandoned) {
-            errorStr = i18n("Image request has been cancelled");
-            qDebug() << "ThumbnailResponse: cancelled for" << mediaId;
-        } else {
-            errorStr = job->errorString();
-            qWarning() << "ThumbnailResponse: no valid image for" << mediaId << "-" << errorStr;
+void ThumbnailResponse::decode() const
+{
+    if (!image.isNull() || !errorStr.isEmpty()) {
+        return;
+    }
+    if (!encoded.isEmpty()) {
+        QBuffer buffer;
+        buffer.setData(encoded);
+        buffer.open(QIODevice::ReadOnly);
+        image = decodeThumbnail(&buffer, encodedMimeType, requestedSize);
+        encoded.clear();
+    } else if (!encodedFile.isEmpty()) {
+        QFile file(encodedFile);
+        QByteArray mimeType;
+        if (openThumbnail(file, &mimeType)) {
+            image = decodeThumbnail(&file, mimeType, requestedSize);
         }
-        job = nullptr;
+        encodedFile.clear();
+    } else {
+        return;
+    }
+
+    if (image.isNull()) {
+        errorStr = i18n("Unable to decode the image");
+        qWarning() << "ThumbnailResponse: unable to decode" << mediaId;
+        return;
+    }
+    ImageCache::instance().insert(mediaId, requestedSize, image);
+}
+
+ThumbnailResponse::~ThumbnailResponse()
+{
+    // The engine may delete a cancelled response before doCancel() runs
+    if (waiting) {
+        ThumbnailJobs::instance().detach(this);
     }
-    Q_EMIT finished();
 }
 
 void ThumbnailResponse::doCancel()
 {
     // Runs in the main thread, not QML thread
-    if (job) {
-        Q_ASSERT(QThread::currentThread() == job->thread());
-        job->abandon();
+    if (waiting) {
+        ThumbnailJobs::instance().detach(this);
+        complete({}, {}, i18n("Image request has been cancelled"));
+        qDebug() << "ThumbnailResponse: cancelled for" << mediaId;
     }
 }
 
 QQuickTextureFactory *ThumbnailResponse::textureFactory() const
 {
-    QReadLocker _(&lock);
+    QWriteLocker _(&lock);
+    decode();
     return QQuickTextureFactory::textureFactoryForImage(image);
 }
 
+void ThumbnailResponse::decodeIntoCache() const
+{
+    QWriteLocker _(&lock);
+    decode();
+}
+
 QString ThumbnailResponse::errorString() const
 {
-    QReadLocker _(&lock);
+    QWriteLocker _(&lock);
+    decode();
     return errorStr;
 }
 
@@ -11,37 +11,126 @@
 #include <QQuickAsyncImageProvider>
 
 #include <connection.h>
-#include <jobs/mediathumbnailjob.h>
+
+#include "mediajobscheduler.h"
 
 #include <QAtomicPointer>
+#include <QHash>
 #include <QReadWriteLock>
+#include <QThreadPool>
+#include <QVector>
 
 namespace Quotient
 {
 class Connection;
 }
+class ThumbnailJob;
+
+class ThumbnailResponse;
+
+/// Thumbnail downloads in flight, by account, media ID and size class.
+///
+/// A response for a thumbnail that is already being downloaded waits for
+/// that download instead of starting its own, and all waiting responses are
+/// completed from its result. A download is only abandoned once all of its
+/// responses have been cancelled. Only used from the main thread.
+///
+/// Every account downloads with its own connection; media without an account
+/// is downloaded by the active one. Requests wait until their connection is
+/// there and fail once it is logged out. Downloads go through
+/// MediaJobScheduler with the most urgent priority of their responses, and a
+/// download whose responses are all cancelled before it started never
+/// reaches the network.
+///
+/// Downloaded thumbnails are written to the disk cache as they are, on a
+/// background thread.
+class ThumbnailJobs : public QObject
+{
+    Q_OBJECT
+public:
+    static ThumbnailJobs &instance();
+
+    /// Wait for the thumbnail of the response, downloading it if needed
+    void attach(ThumbnailResponse *response);
+    /// Stop waiting, abandoning the download if nobody else waits for it
+    void detach(ThumbnailResponse *response);
+
+private:
+    ThumbnailJobs();
+    ~ThumbnailJobs() override;
+
+    struct InFlight {
+        /// User ID of the connection to download with, empty until there is an active one
+        QString account;
+        QString mediaId;
+        QSize size;
+        QString localFile;
+        /// Zero until the connection is there
+        MediaJobScheduler::Ticket ticket = 0;
+        /// Null while the download is queued
+        ThumbnailJob *job = nullptr;
+        QVector<ThumbnailResponse *> waiters;
+    };
+    QHash<QString, InFlight> m_jobs;
+    QThreadPool m_ioPool;
+
+    void schedule(const QString &key);
+    void scheduleWaiting(const QString &account);
+    void startJob(const QString &key);
+    void complete(const QString &key);
+    void failJobs(const QString &account, const QString &error);
+
+    [[nodiscard]] static Quotient::Connection *connection(const QString &account);
+    [[nodiscard]] static MediaJobScheduler::Priority priority(const InFlight &inFlight);
+
+    [[nodiscard]] static QString key(const ThumbnailResponse *response);
+};
 
 class ThumbnailResponse : public QQuickImageResponse
 {
     Q_OBJECT
 public:
-    ThumbnailResponse(QString mediaId, QSize requestedSize);
-    ~ThumbnailResponse() override = default;
+    /// The ID is "<server>/<media>", optionally prefixed with the percent-encoded user ID of the account
+    ThumbnailResponse(const QString &id, QSize requestedSize, bool prefetch = false);
+    ~ThumbnailResponse() override;
+
+    /// Whether finished() has been emitted, possibly from the constructor already
+    [[nodiscard]] bool isFinished() const;
+
+    /// Decodes the downloaded image into the image cache, unless already done
+    void decodeIntoCache() const;
 
 private Q_SLOTS:
     void startRequest();
-    void prepareResult();
     void doCancel();
 
 private:
+    friend class ThumbnailJobs;
+
+    /// Empty for the active account
+    const QString account;
     const QString mediaId;
-    QSize requestedSize;
+    const QSize requestedSize;
+    /// The size class the thumbnail is downloaded and cached in
+    const QSize thumbnailSize;
     const QString localFile;
-    Quotient::MediaThumbnailJob *job = nullptr;
+    const MediaJobScheduler::Priority priority;
+    /// Whether the response waits for a download of ThumbnailJobs
+    bool waiting = false;
+    bool done = false;
+
+    void finish();
+    void complete(const QByteArray &bytes, const QByteArray &mimeType, const QString &error);
+    /// Decodes the encoded image on first use, with the lock held
+    void decode() const;
 
-    QImage image;
-    QString errorStr;
-    mutable QReadWriteLock lock; // Guards ONLY these two members above
+    mutable QImage image;
+    /// The image before it is decoded, either in memory or in the disk cache
+    mutable QByteArray encoded;
+    QByteArray encodedMimeType;
+    mutable QString encodedFile;
+    mutable QString errorStr;
+    mutable QReadWriteLock lock; // Guards ONLY the members above
 
     QQuickTextureFactory *textureFactory() const override;
     QString errorString() const override;
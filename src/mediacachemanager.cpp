@@ -0,0 +1,275 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "mediacachemanager.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <algorithm>
+
+#include "imagecache.h"
+#include "neochatconfig.h"
+
+static const quint32 IndexMagic = 0x4e434d49; // "NCMI"
+static const quint32 IndexVersion = 1;
+static const auto IndexFileName = QStringLiteral("index");
+static const int SaveDelay = 10000;
+/// Eviction stops at this share of the budget, so it doesn't run on every write
+static const qreal LowWatermark = 0.8;
+
+MediaCacheManager::MediaCacheManager()
+{
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(SaveDelay);
+    connect(&m_saveTimer, &QTimer::timeout, this, &MediaCacheManager::save);
+    m_ioPool.setMaxThreadCount(1);
+
+    m_maxBytes = qint64(NeoChatConfig::self()->mediaCacheSize()) * 1024 * 1024;
+    ImageCache::instance().setMaxBytes(qint64(NeoChatConfig::self()->imageMemoryCacheSize()) * 1024 * 1024);
+    m_ioPool.start([this] {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        load();
+        QMetaObject::invokeMethod(this, &MediaCacheManager::trim, Qt::QueuedConnection);
+    });
+}
+
+MediaCacheManager::~MediaCacheManager()
+{
+    m_ioPool.waitForDone();
+    if (m_dirty) {
+        save();
+        m_ioPool.waitForDone();
+    }
+}
+
+MediaCacheManager &MediaCacheManager::instance()
+{
+    static MediaCacheManager _instance;
+    return _instance;
+}
+
+QString MediaCacheManager::directory()
+{
+    return QStringLiteral("%1/image_provider").arg(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+}
+
+void MediaCacheManager::load()
+{
+    QHash<QString, Entry> entries;
+    QFile file(QDir(directory()).filePath(IndexFileName));
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        quint32 magic;
+        quint32 version;
+        stream >> magic >> version;
+        if (magic == IndexMagic && version == IndexVersion) {
+            stream.setVersion(QDataStream::Qt_5_15);
+            qint32 count;
+            stream >> count;
+            for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+                QString fileName;
+                Entry entry;
+                stream >> fileName >> entry.size >> entry.lastAccess;
+                entries.insert(fileName, entry);
+            }
+        }
+    }
+
+    // The directory is what counts: the index may be older than the files
+    const QDir dir(directory());
+    QHash<QString, Entry> checked;
+    QDirIterator it(dir.path(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const auto name = dir.relativeFilePath(it.filePath());
+        if (name == IndexFileName) {
+            continue;
+        }
+        const auto info = it.fileInfo();
+        auto entry = entries.value(name);
+        if (entry.size != info.size()) {
+            entry.size = info.size();
+            entry.lastAccess = qMax(entry.lastAccess, info.lastModified().toMSecsSinceEpoch());
+        }
+        checked.insert(name, entry);
+    }
+
+    qint64 usage = 0;
+    {
+        QMutexLocker _(&m_mutex);
+        // Files recorded while loading are newer than what was found
+        for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+            checked.insert(it.key(), it.value());
+        }
+        m_entries = checked;
+        for (const auto &entry : qAsConst(m_entries)) {
+            usage += entry.size;
+        }
+        m_usage = usage;
+    }
+    Q_EMIT usageChanged();
+}
+
+void MediaCacheManager::recordAccess(const QString &fileName)
+{
+    const auto name = QDir(directory()).relativeFilePath(fileName);
+    {
+        QMutexLocker _(&m_mutex);
+        const auto it = m_entries.find(name);
+        if (it == m_entries.end()) {
+            return;
+        }
+        it->lastAccess = QDateTime::currentMSecsSinceEpoch();
+    }
+    scheduleSave();
+}
+
+void MediaCacheManager::recordWrite(const QString &fileName, qint64 size)
+{
+    const auto name = QDir(directory()).relativeFilePath(fileName);
+    {
+        QMutexLocker _(&m_mutex);
+        auto &entry = m_entries[name];
+        m_usage += size - entry.size;
+        entry.size = size;
+        entry.lastAccess = QDateTime::currentMSecsSinceEpoch();
+    }
+    Q_EMIT usageChanged();
+    scheduleSave();
+    if (m_usage > m_maxBytes && !m_evicting) {
+        QMetaObject::invokeMethod(this, &MediaCacheManager::trim, Qt::QueuedConnection);
+    }
+}
+
+qint64 MediaCacheManager::usage() const
+{
+    return m_usage;
+}
+
+qint64 MediaCacheManager::memoryUsage() const
+{
+    return ImageCache::instance().residentBytes();
+}
+
+qreal MediaCacheManager::memoryHitRate() const
+{
+    return ImageCache::instance().hitRate();
+}
+
+void MediaCacheManager::trim()
+{
+    ImageCache::instance().setMaxBytes(qint64(NeoChatConfig::self()->imageMemoryCacheSize()) * 1024 * 1024);
+    Q_EMIT usageChanged();
+
+    m_maxBytes = qint64(NeoChatConfig::self()->mediaCacheSize()) * 1024 * 1024;
+    if (m_usage <= m_maxBytes || m_evicting) {
+        return;
+    }
+    m_evicting = true;
+    const auto targetBytes = qint64(m_maxBytes * LowWatermark);
+    m_ioPool.start([this, targetBytes] {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        evict(targetBytes);
+        m_evicting = false;
+    });
+}
+
+void MediaCacheManager::clear()
+{
+    ImageCache::instance().clear();
+    Q_EMIT usageChanged();
+    m_ioPool.start([this] {
+        evict(0);
+    });
+}
+
+void MediaCacheManager::evict(qint64 targetBytes)
+{
+    QVector<QPair<qint64, QString>> candidates;
+    {
+        QMutexLocker _(&m_mutex);
+        candidates.reserve(m_entries.size());
+        for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+            candidates += {it->lastAccess, it.key()};
+        }
+    }
+    // Least recently used first
+    std::sort(candidates.begin(), candidates.end());
+
+    const QDir dir(directory());
+    int removed = 0;
+    for (const auto &candidate : qAsConst(candidates)) {
+        if (m_usage <= targetBytes) {
+            break;
+        }
+        {
+            QMutexLocker _(&m_mutex);
+            const auto it = m_entries.find(candidate.second);
+            // Used again in the meantime
+            if (it == m_entries.end() || it->lastAccess != candidate.first) {
+                continue;
+            }
+            m_usage -= it->size;
+            m_entries.erase(it);
+        }
+        QFile::remove(dir.filePath(candidate.second));
+        ++removed;
+    }
+    qDebug() << "Media cache: evicted" << removed << "files," << m_usage << "bytes left";
+    Q_EMIT usageChanged();
+    scheduleSave();
+}
+
+void MediaCacheManager::scheduleSave()
+{
+    if (m_dirty.testAndSetOrdered(false, true)) {
+        // The timer lives in the main thread
+        QMetaObject::invokeMethod(&m_saveTimer, QOverload<>::of(&QTimer::start), Qt::QueuedConnection);
+    }
+}
+
+void MediaCacheManager::save()
+{
+    QVector<QPair<QString, Entry>> entries;
+    {
+        QMutexLocker _(&m_mutex);
+        m_dirty = false;
+        entries.reserve(m_entries.size());
+        for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+            entries += {it.key(), it.value()};
+        }
+    }
+    m_ioPool.start([entries] {
+        QDir dir(directory());
+        if (!dir.exists() && !dir.mkpath(QStringLiteral("."))) {
+            return;
+        }
+        QSaveFile file(dir.filePath(IndexFileName));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Unable to write the media cache index";
+            return;
+        }
+        QDataStream stream(&file);
+        stream << IndexMagic << IndexVersion;
+        stream.setVersion(QDataStream::Qt_5_15);
+        stream << qint32(entries.size());
+        for (const auto &entry : entries) {
+            stream << entry.first << entry.second.size << entry.second.lastAccess;
+        }
+        if (stream.status() != QDataStream::Ok || !file.commit()) {
+            qWarning() << "Unable to write the media cache index";
+        }
+    });
+}
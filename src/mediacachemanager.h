@@ -0,0 +1,87 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+
+/// Keeps the media cache of the image provider within its size budget.
+///
+/// An index of the size and last access of every cached file is kept in
+/// memory and saved next to the files. Whenever the cache grows beyond the
+/// budget of the settings, the least recently used files are removed by a
+/// background task until it is well below. The index is checked against the
+/// directory on startup, so files written or removed before a crash are
+/// accounted for and a lost index is rebuilt.
+///
+/// Files are recorded from the threads of the image provider, hence access
+/// to the index is serialized.
+///
+/// It also applies the budget of the settings to the ImageCache of decoded
+/// images and reports how well that one does.
+class MediaCacheManager : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(qint64 usage READ usage NOTIFY usageChanged)
+    Q_PROPERTY(qint64 memoryUsage READ memoryUsage NOTIFY usageChanged)
+    Q_PROPERTY(qreal memoryHitRate READ memoryHitRate NOTIFY usageChanged)
+
+public:
+    static MediaCacheManager &instance();
+
+    /// Directory the image provider caches its media in
+    [[nodiscard]] static QString directory();
+
+    /// Call when a cached file has been used
+    void recordAccess(const QString &fileName);
+    /// Call when a file has been written to the cache
+    void recordWrite(const QString &fileName, qint64 size);
+
+    /// Bytes taken up by the cached files
+    [[nodiscard]] qint64 usage() const;
+
+    /// Bytes taken up by the decoded images, see ImageCache::residentBytes()
+    [[nodiscard]] qint64 memoryUsage() const;
+    /// Share of image requests served from memory, see ImageCache::hitRate()
+    [[nodiscard]] qreal memoryHitRate() const;
+
+    /// Evict files and decoded images if the caches exceed the budgets of the settings
+    Q_INVOKABLE void trim();
+    /// Remove all files and decoded images
+    Q_INVOKABLE void clear();
+
+Q_SIGNALS:
+    void usageChanged();
+
+private:
+    MediaCacheManager();
+    ~MediaCacheManager() override;
+
+    struct Entry {
+        qint64 size = 0;
+        qint64 lastAccess = 0;
+    };
+
+    mutable QMutex m_mutex;
+    /// By file name within directory()
+    QHash<QString, Entry> m_entries;
+    QAtomicInteger<qint64> m_usage = 0;
+    QAtomicInteger<qint64> m_maxBytes = 0;
+    QAtomicInteger<bool> m_evicting = false;
+    QAtomicInteger<bool> m_dirty = false;
+    QTimer m_saveTimer;
+    QThreadPool m_ioPool;
+
+    void load();
+    void evict(qint64 targetBytes);
+    void scheduleSave();
+    void save();
+};
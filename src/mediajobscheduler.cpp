@@ -0,0 +1,90 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "mediajobscheduler.h"
+
+#include "neochatconfig.h"
+
+MediaJobScheduler &MediaJobScheduler::instance()
+{
+    static MediaJobScheduler _instance;
+    return _instance;
+}
+
+MediaJobScheduler::Ticket MediaJobScheduler::enqueue(const QString &host, Priority priority, std::function<void()> start)
+{
+    const auto ticket = m_nextTicket++;
+    m_queued.insert(ticket, Job {host, priority, std::move(start)});
+    m_queues[host].insert({priority, ticket}, ticket);
+    // Started from the event loop, so that the caller has the ticket first
+    QMetaObject::invokeMethod(
+        this,
+        [this, host] {
+            startJobs(host);
+        },
+        Qt::QueuedConnection);
+    return ticket;
+}
+
+void MediaJobScheduler::setPriority(Ticket ticket, Priority priority)
+{
+    const auto it = m_queued.find(ticket);
+    if (it == m_queued.end() || it->priority == priority) {
+        return;
+    }
+    auto &queue = m_queues[it->host];
+    queue.remove({it->priority, ticket});
+    it->priority = priority;
+    queue.insert({priority, ticket}, ticket);
+}
+
+bool MediaJobScheduler::cancel(Ticket ticket)
+{
+    const auto it = m_queued.find(ticket);
+    if (it == m_queued.end()) {
+        return false;
+    }
+    m_queues[it->host].remove({it->priority, ticket});
+    m_queued.erase(it);
+    return true;
+}
+
+void MediaJobScheduler::finish(Ticket ticket)
+{
+    const auto it = m_running.find(ticket);
+    if (it == m_running.end()) {
+        return;
+    }
+    const auto host = *it;
+    m_running.erase(it);
+    --m_runningPerHost[host];
+    startJobs(host);
+}
+
+bool MediaJobScheduler::isQueued(Ticket ticket) const
+{
+    return m_queued.contains(ticket);
+}
+
+void MediaJobScheduler::startQueued()
+{
+    const auto hosts = m_queues.keys();
+    for (const auto &host : hosts) {
+        startJobs(host);
+    }
+}
+
+void MediaJobScheduler::startJobs(const QString &host)
+{
+    const int maxJobs = NeoChatConfig::self()->mediaJobsPerHost();
+    auto &queue = m_queues[host];
+    while (m_runningPerHost.value(host) < maxJobs && !queue.isEmpty()) {
+        const auto ticket = queue.take(queue.firstKey());
+        const auto job = m_queued.take(ticket);
+        m_running.insert(ticket, host);
+        ++m_runningPerHost[host];
+        job.start();
+    }
+}
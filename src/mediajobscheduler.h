@@ -0,0 +1,77 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QPair>
+#include <QString>
+
+#include <functional>
+
+/// Decides when media jobs go to the network.
+///
+/// Jobs are queued per host with a priority class, and only a limited number
+/// run per host at a time, the most urgent ones first; among jobs of the same
+/// class the oldest goes first. A queued job can be moved to another class,
+/// for instance when its delegate appears, or be cancelled without ever
+/// reaching the network. Only used from the main thread.
+class MediaJobScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// Most urgent first
+    enum Priority {
+        /// Files the user asked to open or save
+        UserDownload,
+        VisibleImage,
+        VisibleAvatar,
+        Prefetch,
+        /// Files nobody is waiting for
+        BackgroundDownload,
+    };
+    Q_ENUM(Priority)
+
+    using Ticket = quint64;
+
+    static MediaJobScheduler &instance();
+
+    /// Queue a job; start is called once it may run, after which finish() has to be called.
+    [[nodiscard]] Ticket enqueue(const QString &host, Priority priority, std::function<void()> start);
+    /// Move a queued job to another class; no effect on running jobs
+    void setPriority(Ticket ticket, Priority priority);
+    /// Remove a queued job. False if it is running already or unknown.
+    bool cancel(Ticket ticket);
+    /// Call when a running job is done, to start the next one of its host
+    void finish(Ticket ticket);
+
+    [[nodiscard]] bool isQueued(Ticket ticket) const;
+
+    /// Start the queued jobs the current limit allows, call when it has been raised
+    Q_INVOKABLE void startQueued();
+
+private:
+    MediaJobScheduler() = default;
+
+    struct Job {
+        QString host;
+        Priority priority;
+        std::function<void()> start;
+    };
+    /// Queue position: class, then order of arrival
+    using Position = QPair<int, Ticket>;
+
+    Ticket m_nextTicket = 1;
+    QHash<Ticket, Job> m_queued;
+    QHash<QString, QMap<Position, Ticket>> m_queues;
+    /// Host of each running job
+    QHash<Ticket, QString> m_running;
+    QHash<QString, int> m_runningPerHost;
+
+    void startJobs(const QString &host);
+};
@@ -0,0 +1,398 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "mergedroomlistmodel.h"
+
+#include <algorithm>
+#include <queue>
+
+#include "controller.h"
+#include "settings.h"
+
+MergedRoomListModel::MergedRoomListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+    auto &controller = Controller::instance();
+    connect(&controller, &Controller::connectionAdded, this, &MergedRoomListModel::addConnection);
+    connect(&controller, &Controller::connectionDropped, this, [this](Connection *connection) {
+        removeShard(connection->userId());
+    });
+    // An account that failed to connect won't replace its room summaries.
+    // Accounts that are still connecting when the startup gives up waiting
+    // for them keep their summaries until they report.
+    connect(&controller, &Controller::accountLoginFinished, this, [this](const QString &userId) {
+        const auto shard = m_shards.value(userId);
+        if (shard && !shard->connection()) {
+            removeShard(userId);
+        }
+    });
+
+    m_mergingShards = true;
+    const auto connections = controller.connections();
+    for (auto connection : connections) {
+        addConnection(connection);
+    }
+    if (connections.isEmpty()) {
+        const auto accounts = SettingsGroup("Accounts").childGroups();
+        for (const auto &accountId : accounts) {
+            AccountSettings account {accountId};
+            if (!account.homeserver().isEmpty()) {
+                createShard(account.userId())->loadSummaries(account.userId());
+            }
+        }
+    }
+    m_mergingShards = false;
+    mergeShards();
+}
+
+RoomListModel *MergedRoomListModel::createShard(const QString &userId)
+{
+    auto shard = new RoomListModel(this);
+    m_shards.insert(userId, shard);
+
+    connect(shard, &QAbstractItemModel::rowsInserted, this, [this, shard](const QModelIndex &, int first, int last) {
+        if (m_mergingShards) {
+            return;
+        }
+        // Rooms are usually appended, which doesn't move the others
+        if (last + 1 < shard->rowCount()) {
+            renumberShardRows(shard, first, last - first + 1);
+        }
+        for (int row = first; row <= last; ++row) {
+            insertRoom(shard, row);
+        }
+    });
+    connect(shard, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this, shard](const QModelIndex &, int first, int last) {
+        for (int row = last; row >= first; --row) {
+            removeRoom(shard, row);
+        }
+    });
+    connect(shard, &QAbstractItemModel::rowsRemoved, this, [this, shard](const QModelIndex &, int first, int last) {
+        if (first < shard->rowCount()) {
+            renumberShardRows(shard, last + 1, -(last - first + 1));
+        }
+    });
+    connect(shard, &QAbstractItemModel::dataChanged, this, [this, shard](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            updateRoom(shard, row, roles);
+        }
+    });
+    // The rows of the shard are taken out while the shard can still be read,
+    // and put back once it is reset; the rows of other shards stay
+    connect(shard, &QAbstractItemModel::modelAboutToBeReset, this, [this, shard] {
+        removeShardRooms(shard);
+    });
+    connect(shard, &QAbstractItemModel::modelReset, this, [this, shard] {
+        if (!m_mergingShards) {
+            insertShardRooms(shard);
+        }
+    });
+    connect(shard, &RoomListModel::notificationCountChanged, this, &MergedRoomListModel::notificationCountChanged);
+    connect(shard, &RoomListModel::aboutToCommitTransaction, this, &MergedRoomListModel::aboutToCommitTransaction);
+    connect(shard, &RoomListModel::transactionCommitted, this, &MergedRoomListModel::transactionCommitted);
+    return shard;
+}
+
+void MergedRoomListModel::addConnection(Connection *connection)
+{
+    auto shard = m_shards.value(connection->userId());
+    if (!shard) {
+        shard = createShard(connection->userId());
+    }
+    shard->setConnection(connection);
+}
+
+void MergedRoomListModel::removeShard(const QString &userId)
+{
+    auto shard = m_shards.take(userId);
+    if (!shard) {
+        return;
+    }
+    shard->disconnect(this);
+    removeShardRooms(shard);
+    shard->deleteLater();
+    Q_EMIT notificationCountChanged();
+}
+
+void MergedRoomListModel::removeShardRooms(RoomListModel *shard)
+{
+    // Remove the rows of the shard from the bottom up, a run of adjacent rows at a time
+    for (int last = m_entries.size() - 1; last >= 0; --last) {
+        if (m_entries[last].key.first != shard) {
+            continue;
+        }
+        int first = last;
+        while (first > 0 && m_entries[first - 1].key.first == shard) {
+            --first;
+        }
+        beginRemoveRows({}, first, last);
+        for (int row = first; row <= last; ++row) {
+            m_lastActive.remove(m_entries[row].key);
+        }
+        m_entries.remove(first, last - first + 1);
+        endRemoveRows();
+        last = first;
+    }
+}
+
+void MergedRoomListModel::renumberShardRows(RoomListModel *shard, int firstRow, int delta)
+{
+    for (auto &entry : m_entries) {
+        if (entry.key.first == shard && entry.shardRow >= firstRow) {
+            entry.shardRow += delta;
+        }
+    }
+}
+
+MergedRoomListModel::Key MergedRoomListModel::keyOf(RoomListModel *shard, int shardRow)
+{
+    return {shard, shard->data(shard->index(shardRow), RoomListModel::RoomIdRole).toString()};
+}
+
+qint64 MergedRoomListModel::lastActiveOf(RoomListModel *shard, int shardRow)
+{
+    return shard->data(shard->index(shardRow), RoomListModel::LastActiveTimeRole).toDateTime().toMSecsSinceEpoch();
+}
+
+QVector<MergedRoomListModel::Entry> MergedRoomListModel::shardEntries(RoomListModel *shard)
+{
+    QVector<Entry> entries;
+    entries.reserve(shard->rowCount());
+    for (int row = 0; row < shard->rowCount(); ++row) {
+        entries.append(Entry {keyOf(shard, row), lastActiveOf(shard, row), row});
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &left, const Entry &right) {
+        return left.lastActive > right.lastActive;
+    });
+    return entries;
+}
+
+void MergedRoomListModel::mergeShards()
+{
+    QVector<QVector<Entry>> runs;
+    int size = 0;
+    for (const auto shard : qAsConst(m_shards)) {
+        runs += shardEntries(shard);
+        size += runs.last().size();
+    }
+
+    // k-way merge: the heap holds the next room of every run, the most
+    // recently active one on top
+    using Head = QPair<int, int>; // Run and position in the run
+    const auto laterFirst = [&runs](const Head &left, const Head &right) {
+        const auto leftActive = runs[left.first][left.second].lastActive;
+        const auto rightActive = runs[right.first][right.second].lastActive;
+        return leftActive != rightActive ? leftActive < rightActive : left.first > right.first;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(laterFirst)> heads(laterFirst);
+    for (int run = 0; run < runs.size(); ++run) {
+        if (!runs[run].isEmpty()) {
+            heads.push({run, 0});
+        }
+    }
+
+    beginResetModel();
+    m_entries.clear();
+    m_entries.reserve(size);
+    m_lastActive.clear();
+    while (!heads.empty()) {
+        const auto head = heads.top();
+        heads.pop();
+        const auto &entry = runs[head.first][head.second];
+        m_entries.append(entry);
+        m_lastActive.insert(entry.key, entry.lastActive);
+        if (head.second + 1 < runs[head.first].size()) {
+            heads.push({head.first, head.second + 1});
+        }
+    }
+    endResetModel();
+}
+
+void MergedRoomListModel::insertShardRooms(RoomListModel *shard)
+{
+    // Merged into the list as it is, which keeps the rows of the other shards
+    const auto run = shardEntries(shard);
+    if (run.isEmpty()) {
+        return;
+    }
+    for (const auto &entry : qAsConst(run)) {
+        m_lastActive.insert(entry.key, entry.lastActive);
+    }
+
+    if (m_entries.isEmpty()) {
+        beginInsertRows({}, 0, run.size() - 1);
+        m_entries = run;
+        endInsertRows();
+        return;
+    }
+
+    // Merge the ordered rooms of the shard into the list, inserting each run
+    // of rooms that end up next to each other at once. The rooms of the shard
+    // go after the rooms with the same activity, as in insertRoom().
+    int row = 0;
+    for (int first = 0; first < run.size();) {
+        while (row < m_entries.size() && m_entries[row].lastActive >= run[first].lastActive) {
+            ++row;
+        }
+        int last = first;
+        while (last + 1 < run.size() && (row == m_entries.size() || run[last + 1].lastActive > m_entries[row].lastActive)) {
+            ++last;
+        }
+        beginInsertRows({}, row, row + last - first);
+        m_entries.insert(row, last - first + 1, Entry {});
+        std::copy(run.begin() + first, run.begin() + last + 1, m_entries.begin() + row);
+        endInsertRows();
+        row += last - first + 1;
+        first = last + 1;
+    }
+}
+
+int MergedRoomListModel::insertPosition(qint64 lastActive) const
+{
+    // After the rooms with the same activity
+    const auto it = std::upper_bound(m_entries.begin(), m_entries.end(), lastActive, [](qint64 value, const Entry &other) {
+        return value > other.lastActive;
+    });
+    return int(it - m_entries.begin());
+}
+
+int MergedRoomListModel::rowOf(const Key &key) const
+{
+    const auto lastActiveIt = m_lastActive.constFind(key);
+    if (lastActiveIt == m_lastActive.constEnd()) {
+        return -1;
+    }
+    const auto lastActive = *lastActiveIt;
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), lastActive, [](const Entry &other, qint64 value) {
+        return other.lastActive > value;
+    });
+    for (; it != m_entries.end() && it->lastActive == lastActive; ++it) {
+        if (it->key == key) {
+            return int(it - m_entries.begin());
+        }
+    }
+    return -1;
+}
+
+void MergedRoomListModel::insertRoom(RoomListModel *shard, int shardRow)
+{
+    const auto key = keyOf(shard, shardRow);
+    const auto lastActive = lastActiveOf(shard, shardRow);
+    const int row = insertPosition(lastActive);
+    beginInsertRows({}, row, row);
+    m_entries.insert(row, Entry {key, lastActive, shardRow});
+    m_lastActive.insert(key, lastActive);
+    endInsertRows();
+}
+
+void MergedRoomListModel::removeRoom(RoomListModel *shard, int shardRow)
+{
+    const auto key = keyOf(shard, shardRow);
+    const int row = rowOf(key);
+    if (row < 0) {
+        return;
+    }
+    beginRemoveRows({}, row, row);
+    m_entries.removeAt(row);
+    m_lastActive.remove(key);
+    endRemoveRows();
+}
+
+void MergedRoomListModel::updateRoom(RoomListModel *shard, int shardRow, const QVector<int> &roles)
+{
+    const auto key = keyOf(shard, shardRow);
+    int row = rowOf(key);
+    if (row < 0) {
+        return;
+    }
+
+    // Finding the last activity walks the timeline; only do it when it can have changed
+    if (roles.isEmpty() || roles.contains(RoomListModel::LastActiveTimeRole) || roles.contains(RoomListModel::LastEventRole)) {
+        const auto lastActive = lastActiveOf(shard, shardRow);
+        if (lastActive != m_entries[row].lastActive) {
+            auto entry = m_entries.takeAt(row);
+            entry.lastActive = lastActive;
+            const int newRow = insertPosition(lastActive);
+            m_entries.insert(row, entry);
+            m_lastActive.insert(key, lastActive);
+
+            if (newRow != row) {
+                beginMoveRows({}, row, row, {}, newRow > row ? newRow + 1 : newRow);
+                m_entries.move(row, newRow);
+                endMoveRows();
+                row = newRow;
+            }
+        }
+    }
+
+    Q_EMIT dataChanged(index(row), index(row), roles);
+}
+
+int MergedRoomListModel::notificationCount() const
+{
+    int count = 0;
+    for (const auto shard : m_shards) {
+        count += shard->notificationCount();
+    }
+    return count;
+}
+
+int MergedRoomListModel::highlightCount() const
+{
+    int count = 0;
+    for (const auto shard : m_shards) {
+        count += shard->highlightCount();
+    }
+    return count;
+}
+
+int MergedRoomListModel::categoryNotificationCount(int category, const QString &accountId) const
+{
+    if (!accountId.isEmpty()) {
+        const auto shard = m_shards.value(accountId);
+        return shard ? shard->categoryNotificationCount(category) : 0;
+    }
+    int count = 0;
+    for (const auto shard : m_shards) {
+        count += shard->categoryNotificationCount(category);
+    }
+    return count;
+}
+
+int MergedRoomListModel::categoryHighlightCount(int category, const QString &accountId) const
+{
+    if (!accountId.isEmpty()) {
+        const auto shard = m_shards.value(accountId);
+        return shard ? shard->categoryHighlightCount(category) : 0;
+    }
+    int count = 0;
+    for (const auto shard : m_shards) {
+        count += shard->categoryHighlightCount(category);
+    }
+    return count;
+}
+
+int MergedRoomListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_entries.size();
+}
+
+QVariant MergedRoomListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_entries.size()) {
+        return {};
+    }
+    const auto &entry = m_entries.at(index.row());
+    const auto shard = entry.key.first;
+    return shard->data(shard->index(entry.shardRow), role);
+}
+
+QHash<int, QByteArray> MergedRoomListModel::roleNames() const
+{
+    return RoomListModel::roomRoleNames();
+}
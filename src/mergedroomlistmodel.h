@@ -0,0 +1,94 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+
+#include "roomlistmodel.h"
+
+/// The rooms of all accounts in one list, most recently active first.
+///
+/// Each account gets its own RoomListModel shard, which keeps itself up to
+/// date independently of the others. The shards are merged by last activity:
+/// the list of all shards is built with a k-way merge of their ordered rooms.
+/// When a shard is reset its rows are removed and its ordered rooms merged
+/// back into the list, and when a single room changes it is inserted with a
+/// binary search or its row is moved, so neither a sync nor a reset of one
+/// account touches the rows of another. A row refers to its room by shard
+/// and row in the shard, which are renumbered when rows are inserted into or
+/// removed from the middle of a shard. Restricting the list to one account
+/// is left to AccountFilterModel. The transactions of the shards are
+/// relayed, see RoomListModel::beginTransaction().
+///
+/// The shards of the known accounts are created right away and show their
+/// rooms from their room summary indexes until the accounts are connected,
+/// or are removed when an account fails to connect.
+class MergedRoomListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int notificationCount READ notificationCount NOTIFY notificationCountChanged)
+    Q_PROPERTY(int highlightCount READ highlightCount NOTIFY notificationCountChanged)
+
+public:
+    explicit MergedRoomListModel(QObject *parent = nullptr);
+
+    /// Sums of the counters of all shards
+    [[nodiscard]] int notificationCount() const;
+    [[nodiscard]] int highlightCount() const;
+    /// Sums of the category counters of the shards, or of the shard of one account
+    [[nodiscard]] int categoryNotificationCount(int category, const QString &accountId = {}) const;
+    [[nodiscard]] int categoryHighlightCount(int category, const QString &accountId = {}) const;
+
+    [[nodiscard]] QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    [[nodiscard]] QHash<int, QByteArray> roleNames() const override;
+
+Q_SIGNALS:
+    void notificationCountChanged();
+    void aboutToCommitTransaction();
+    void transactionCommitted();
+
+private:
+    /// A room is identified by its shard and its ID
+    using Key = QPair<RoomListModel *, QString>;
+
+    struct Entry {
+        Key key;
+        qint64 lastActive;
+        /// Row of the room in its shard, where its roles are read from
+        int shardRow;
+    };
+    /// All rooms, most recently active first
+    QVector<Entry> m_entries;
+    /// Last activity of each room in m_entries, to find its row
+    QHash<Key, qint64> m_lastActive;
+    /// Shards by user ID
+    QHash<QString, RoomListModel *> m_shards;
+    /// While the shards are filled before they are merged all at once
+    bool m_mergingShards = false;
+
+    RoomListModel *createShard(const QString &userId);
+    void removeShard(const QString &userId);
+    void addConnection(Connection *connection);
+    void removeShardRooms(RoomListModel *shard);
+    void insertShardRooms(RoomListModel *shard);
+    /// Build the list from all shards
+    void mergeShards();
+    /// Add \p delta to the rows of the rooms of \p shard from \p firstRow on
+    void renumberShardRows(RoomListModel *shard, int firstRow, int delta);
+    void insertRoom(RoomListModel *shard, int shardRow);
+    void removeRoom(RoomListModel *shard, int shardRow);
+    void updateRoom(RoomListModel *shard, int shardRow, const QVector<int> &roles);
+
+    /// The rooms of a shard, most recently active first
+    [[nodiscard]] static QVector<Entry> shardEntries(RoomListModel *shard);
+    [[nodiscard]] static Key keyOf(RoomListModel *shard, int shardRow);
+    [[nodiscard]] static qint64 lastActiveOf(RoomListModel *shard, int shardRow);
+    [[nodiscard]] int rowOf(const Key &key) const;
+    [[nodiscard]] int insertPosition(qint64 lastActive) const;
+};
@@ -17,6 +17,7 @@
 #include <QDebug>
 #include <QQmlEngine> // for qmlRegisterType()
 #include <QTimeZone>
+#include <QUrl>
 
 #include <KLocalizedString>
 
@@ -43,6 +44,9 @@ QHash<int, QByteArray> MessageEventModel::roleNames() const
     roles[UserMarkerRole] = "userMarker";
     roles[ShowAuthorRole] = "showAuthor";
     roles[ShowSectionRole] = "showSection";
+    roles[ThumbnailMediaIdRole] = "thumbnailMediaId";
+    roles[ThumbnailSizeRole] = "thumbnailSize";
+    roles[AuthorAvatarMediaIdRole] = "authorAvatarMediaId";
     roles[ReactionRole] = "reaction";
     return roles;
 }
@@ -373,6 +377,32 @@ QVariant MessageEventModel::data(const QModelIndex &idx, int role) const
         return userAtEvent(author, m_currentRoom, evt);
     }
 
+    if (role == AuthorAvatarMediaIdRole) {
+        auto author = static_cast<NeoChatUser *>(isPending ? m_currentRoom->localUser() : m_currentRoom->user(evt.senderId()));
+        return author->avatarMediaId(m_currentRoom);
+    }
+
+    if (role == ThumbnailMediaIdRole || role == ThumbnailSizeRole) {
+        auto e = eventCast<const RoomMessageEvent>(&evt);
+        if (!e || evt.isRedacted() || (e->msgtype() != MessageEventType::Image && e->msgtype() != MessageEventType::Video)) {
+            return {};
+        }
+        // What ImageDelegate and VideoDelegate request
+        const auto content = e->contentJson();
+        const auto info = content["info"].toObject();
+        const auto thumbnailInfo = info["thumbnail_info"].toObject();
+        const bool hasThumbnail = !thumbnailInfo.isEmpty() && info.contains("thumbnail_url");
+        if (!hasThumbnail && e->msgtype() == MessageEventType::Video) {
+            return {};
+        }
+        if (role == ThumbnailMediaIdRole) {
+            const QUrl url(hasThumbnail ? info["thumbnail_url"].toString() : content["url"].toString());
+            return url.scheme() == "mxc" ? url.authority() + url.path() : QString();
+        }
+        const auto sizeInfo = e->msgtype() == MessageEventType::Video ? thumbnailInfo : info;
+        return QSize(sizeInfo["w"].toInt(), sizeInfo["h"].toInt());
+    }
+
     if (role == ContentTypeRole) {
         if (auto e = eventCast<const RoomMessageEvent>(&evt)) {
             const auto &contentType = e->mimeType().name();
@@ -40,6 +40,11 @@ public:
 
         ReactionRole,
 
+        /// Media ID and size of the image shown for an image or video, for prefetching
+        ThumbnailMediaIdRole,
+        ThumbnailSizeRole,
+        AuthorAvatarMediaIdRole,
+
         // For debugging
         EventResolvedTypeRole,
     };
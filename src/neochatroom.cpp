@@ -29,6 +29,7 @@
 #include "events/roompowerlevelsevent.h"
 #include "events/typingevent.h"
 #include "jobs/downloadfilejob.h"
+#include "mediajobscheduler.h"
 #include "notificationsmanager.h"
 #include "user.h"
 #include "utils.h"
@@ -45,6 +46,9 @@ NeoChatRoom::NeoChatRoom(Connection *connection, QString roomId, JoinState joinS
         setFileUploadingProgress(0);
         setHasFileUploading(false);
     });
+    connect(this, &Room::fileTransferCompleted, this, &NeoChatRoom::finishDownload);
+    connect(this, &Room::fileTransferFailed, this, &NeoChatRoom::finishDownload);
+    connect(this, &Room::fileTransferCancelled, this, &NeoChatRoom::finishDownload);
     connect(this, &NeoChatRoom::notificationCountChanged, this, [this]() {
         if (messageEvents().size() == 0) {
             return;
@@ -76,6 +80,10 @@ NeoChatRoom::NeoChatRoom(Connection *connection, QString roomId, JoinState joinS
 
     connect(this, &Quotient::Room::eventsHistoryJobChanged,
             this, &NeoChatRoom::lastActiveTimeChanged);
+
+    connect(this, &Room::readMarkerMoved, this, [this] {
+        setReadMarkerPending(false);
+    });
 }
 
 void NeoChatRoom::uploadFile(const QUrl &url, const QString &body)
@@ -106,6 +114,57 @@ void NeoChatRoom::uploadFile(const QUrl &url, const QString &body)
     });
 }
 
+NeoChatRoom::~NeoChatRoom()
+{
+    const auto tickets = m_downloadTickets;
+    for (const auto ticket : tickets) {
+        if (!MediaJobScheduler::instance().cancel(ticket)) {
+            MediaJobScheduler::instance().finish(ticket);
+        }
+    }
+}
+
+void NeoChatRoom::queueDownload(const QString &eventId, const QUrl &localFilename)
+{
+    if (m_downloadTickets.contains(eventId)) {
+        return;
+    }
+    const auto ticket = MediaJobScheduler::instance().enqueue(connection()->homeserver().host(), MediaJobScheduler::UserDownload, [this, eventId, localFilename] {
+        m_queuedDownloads.remove(eventId);
+        Q_EMIT queuedDownloadsChanged();
+        downloadFile(eventId, localFilename);
+        // Nothing was started, so nothing will report back
+        if (m_downloadTickets.contains(eventId) && fileTransferInfo(eventId).status != FileTransferInfo::Started) {
+            finishDownload(eventId);
+        }
+    });
+    m_downloadTickets.insert(eventId, ticket);
+    m_queuedDownloads.insert(eventId);
+    Q_EMIT queuedDownloadsChanged();
+}
+
+QStringList NeoChatRoom::queuedDownloads() const
+{
+    return m_queuedDownloads.values();
+}
+
+void NeoChatRoom::finishDownload(const QString &eventId)
+{
+    const auto it = m_downloadTickets.find(eventId);
+    if (it == m_downloadTickets.end()) {
+        return;
+    }
+    const auto ticket = *it;
+    m_downloadTickets.erase(it);
+    if (m_queuedDownloads.remove(eventId)) {
+        Q_EMIT queuedDownloadsChanged();
+    }
+    // Cancelling a queued download only takes it off the queue
+    if (!MediaJobScheduler::instance().cancel(ticket)) {
+        MediaJobScheduler::instance().finish(ticket);
+    }
+}
+
 void NeoChatRoom::acceptInvitation()
 {
     connection()->joinRoom(id());
@@ -682,3 +741,17 @@ bool NeoChatRoom::readMarkerLoaded() const
     const auto it = findInTimeline(readMarkerEventId());
     return it != timelineEdge();
 }
+
+bool NeoChatRoom::readMarkerPending() const
+{
+    return m_readMarkerPending;
+}
+
+void NeoChatRoom::setReadMarkerPending(bool pending)
+{
+    if (m_readMarkerPending == pending) {
+        return;
+    }
+    m_readMarkerPending = pending;
+    Q_EMIT unreadMessagesChanged(this);
+}
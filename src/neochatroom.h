@@ -32,9 +32,12 @@ class NeoChatRoom : public Room
     Q_PROPERTY(QString avatarMediaId READ avatarMediaId NOTIFY avatarChanged STORED false)
     Q_PROPERTY(bool readMarkerLoaded READ readMarkerLoaded NOTIFY readMarkerLoadedChanged)
     Q_PROPERTY(QDateTime lastActiveTime READ lastActiveTime NOTIFY lastActiveTimeChanged)
+    /// IDs of the events whose files wait for MediaJobScheduler to download them
+    Q_PROPERTY(QStringList queuedDownloads READ queuedDownloads NOTIFY queuedDownloadsChanged)
 
 public:
     explicit NeoChatRoom(Connection *connection, QString roomId, JoinState joinState = {});
+    ~NeoChatRoom() override;
 
     [[nodiscard]] QVariantList getUsersTyping() const;
 
@@ -85,6 +88,11 @@ public:
 
     [[nodiscard]] bool readMarkerLoaded() const;
 
+    /// Whether the room is queued to be marked as read by ReadMarkerQueue.
+    /// The room is shown as read meanwhile.
+    [[nodiscard]] bool readMarkerPending() const;
+    void setReadMarkerPending(bool pending);
+
     Q_INVOKABLE [[nodiscard]] int savedTopVisibleIndex() const;
     Q_INVOKABLE [[nodiscard]] int savedBottomVisibleIndex() const;
     Q_INVOKABLE void saveViewport(int topIndex, int bottomIndex);
@@ -93,6 +101,13 @@ public:
 
     Q_INVOKABLE QUrl urlToMxcUrl(const QUrl &mxcUrl);
 
+    /// Download the file of the event once MediaJobScheduler lets it run.
+    ///
+    /// Meant for files the user asked for, which go before any other media
+    /// of the server.
+    Q_INVOKABLE void queueDownload(const QString &eventId, const QUrl &localFilename = {});
+    [[nodiscard]] QStringList queuedDownloads() const;
+
     [[nodiscard]] QString avatarMediaId() const;
 
     [[nodiscard]] QString eventToString(const RoomEvent &evt, Qt::TextFormat format = Qt::PlainText, bool removeReply = true) const;
@@ -108,8 +123,13 @@ private:
 
     bool m_hasFileUploading = false;
     int m_fileUploadingProgress = 0;
+    bool m_readMarkerPending = false;
+    /// MediaJobScheduler tickets of the downloads, by event ID
+    QHash<QString, quint64> m_downloadTickets;
+    QSet<QString> m_queuedDownloads;
 
     void checkForHighlights(const Quotient::TimelineItem &ti);
+    void finishDownload(const QString &eventId);
 
     void onAddNewTimelineEvents(timeline_iter_t from) override;
     void onAddHistoricalTimelineEvents(rev_iter_t from) override;
@@ -128,6 +148,7 @@ Q_SIGNALS:
     void backgroundChanged();
     void readMarkerLoadedChanged();
     void lastActiveTimeChanged();
+    void queuedDownloadsChanged();
 
 public Q_SLOTS:
     void uploadFile(const QUrl &url, const QString &body = "");
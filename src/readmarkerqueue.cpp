@@ -0,0 +1,112 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "readmarkerqueue.h"
+
+#include "connection.h"
+#include "neochatroom.h"
+
+using namespace Quotient;
+
+// Each room costs a read marker and a receipt request
+static const int RoomsPerStep = 4;
+static const int StepInterval = 500;
+
+ReadMarkerQueue::ReadMarkerQueue(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setInterval(StepInterval);
+    connect(&m_timer, &QTimer::timeout, this, &ReadMarkerQueue::markNext);
+}
+
+void ReadMarkerQueue::markAllAsRead(Connection *connection)
+{
+    const auto rooms = connection->allRooms();
+    for (auto room : rooms) {
+        enqueue(static_cast<NeoChatRoom *>(room));
+    }
+    if (!m_queue.isEmpty() && !m_timer.isActive()) {
+        markNext();
+        m_timer.start();
+    }
+    Q_EMIT progressChanged();
+}
+
+void ReadMarkerQueue::enqueue(NeoChatRoom *room)
+{
+    if (room->joinState() != JoinState::Join || room->readMarkerPending() || room->messageEvents().empty()) {
+        return;
+    }
+    if (!room->hasUnreadMessages() && room->notificationCount() == 0 && room->highlightCount() == 0) {
+        return;
+    }
+
+    if (!running()) {
+        m_total = 0;
+        m_done = 0;
+    }
+    ++m_total;
+    m_queue.enqueue({room, room->messageEvents().rbegin()->get()->id()});
+
+    // Show the room as read right away, until its turn comes
+    room->setReadMarkerPending(true);
+    room->resetNotificationCount();
+    room->resetHighlightCount();
+    connect(room, &Room::addedMessages, this, [this, room] {
+        markNow(room);
+    });
+}
+
+void ReadMarkerQueue::markNext()
+{
+    for (int i = 0; i < RoomsPerStep && !m_queue.isEmpty(); ++i) {
+        mark(m_queue.dequeue());
+    }
+    if (m_queue.isEmpty()) {
+        m_timer.stop();
+    }
+    Q_EMIT progressChanged();
+}
+
+void ReadMarkerQueue::markNow(NeoChatRoom *room)
+{
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue[i].room == room) {
+            mark(m_queue.takeAt(i));
+            if (m_queue.isEmpty()) {
+                m_timer.stop();
+            }
+            Q_EMIT progressChanged();
+            return;
+        }
+    }
+}
+
+void ReadMarkerQueue::mark(const Request &request)
+{
+    ++m_done;
+    if (!request.room) {
+        return;
+    }
+    request.room->disconnect(this);
+    // Moves the local read marker, which also ends the pending state
+    request.room->markMessagesAsRead(request.eventId);
+    request.room->setReadMarkerPending(false);
+}
+
+bool ReadMarkerQueue::running() const
+{
+    return !m_queue.isEmpty();
+}
+
+int ReadMarkerQueue::total() const
+{
+    return m_total;
+}
+
+int ReadMarkerQueue::done() const
+{
+    return m_done;
+}
@@ -0,0 +1,64 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QTimer>
+
+namespace Quotient
+{
+class Connection;
+}
+
+class NeoChatRoom;
+
+/// Marks many rooms as read at once without flooding the server.
+///
+/// Rooms without unread messages or notifications are skipped. The others
+/// are shown as read right away (see NeoChatRoom::readMarkerPending()) and
+/// queued; a few of them at a time get their read marker moved through
+/// Room::markMessagesAsRead(), which updates the room locally and sends the
+/// marker and the receipt like marking a single room does. A queued room
+/// that receives new messages is marked right away, so that the new
+/// messages don't show as read.
+class ReadMarkerQueue : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY progressChanged)
+    Q_PROPERTY(int total READ total NOTIFY progressChanged)
+    Q_PROPERTY(int done READ done NOTIFY progressChanged)
+
+public:
+    explicit ReadMarkerQueue(QObject *parent = nullptr);
+
+    void markAllAsRead(Quotient::Connection *connection);
+
+    [[nodiscard]] bool running() const;
+    /// Number of rooms queued since the queue was last idle.
+    [[nodiscard]] int total() const;
+    [[nodiscard]] int done() const;
+
+Q_SIGNALS:
+    void progressChanged();
+
+private:
+    struct Request {
+        QPointer<NeoChatRoom> room;
+        QString eventId;
+    };
+
+    QQueue<Request> m_queue;
+    QTimer m_timer;
+    int m_total = 0;
+    int m_done = 0;
+
+    void enqueue(NeoChatRoom *room);
+    void markNext();
+    void markNow(NeoChatRoom *room);
+    void mark(const Request &request);
+};
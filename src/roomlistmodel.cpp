@@ -5,7 +5,8 @@
  */
 #include "roomlistmodel.h"
 
-#include "neochatconfig.h"
+#include "statehydrator.h"
+#include "syncscheduler.h"
 #include "user.h"
 #include "utils.h"
 
@@ -13,19 +14,20 @@
 
 #include <QBrush>
 #include <QColor>
+#include <QDateTime>
 #include <QDebug>
 #include <QStandardPaths>
 
 #include <KLocalizedString>
+#include <algorithm>
 #include <utility>
 
 RoomListModel::RoomListModel(QObject *parent)
     : QAbstractListModel(parent)
 {
-    const auto collapsedSections = NeoChatConfig::collapsedSections();
-    for (auto collapsedSection : collapsedSections) {
-        m_categoryVisibility[collapsedSection] = false;
-    }
+    m_countersTimer.setSingleShot(true);
+    m_countersTimer.setInterval(0);
+    connect(&m_countersTimer, &QTimer::timeout, this, &RoomListModel::notificationCountChanged);
 }
 
 RoomListModel::~RoomListModel() = default;
@@ -37,17 +39,25 @@ void RoomListModel::setConnection(Connection *connection)
     }
     if (m_connection) {
         m_connection->disconnect(this);
+        if (auto scheduler = m_connection->findChild<SyncScheduler *>()) {
+            scheduler->disconnect(this);
+        }
     }
     if (!connection) {
         qDebug() << "Removing current connection...";
         m_connection = nullptr;
+        m_accountId.clear();
         beginResetModel();
         m_rooms.clear();
+        m_rows.clear();
+        m_placeholders.clear();
         endResetModel();
+        resetCounts();
         return;
     }
 
     m_connection = connection;
+    m_accountId = connection->userId();
 
     for (NeoChatRoom *room : qAsConst(m_rooms)) {
         room->disconnect(this);
@@ -58,11 +68,14 @@ void RoomListModel::setConnection(Connection *connection)
     connect(connection, &Connection::joinedRoom, this, &RoomListModel::updateRoom);
     connect(connection, &Connection::leftRoom, this, &RoomListModel::updateRoom);
     connect(connection, &Connection::aboutToDeleteRoom, this, &RoomListModel::deleteRoom);
+    // Whatever the first sync didn't bring back has been left in the meantime
+    connect(connection, &Connection::syncDone, this, &RoomListModel::dropPlaceholders);
     connect(connection, &Connection::directChatsListChanged, this, [=](Quotient::DirectChatsMap additions, Quotient::DirectChatsMap removals) {
         auto refreshRooms = [this, &connection](Quotient::DirectChatsMap rooms) {
             for (const QString &roomID : qAsConst(rooms)) {
                 auto room = connection->room(roomID);
                 if (room) {
+                    updateCounts(static_cast<NeoChatRoom *>(room));
                     refresh(static_cast<NeoChatRoom *>(room));
                 }
             }
@@ -71,6 +84,10 @@ void RoomListModel::setConnection(Connection *connection)
         refreshRooms(std::move(additions));
         refreshRooms(std::move(removals));
     });
+    if (auto scheduler = connection->findChild<SyncScheduler *>()) {
+        connect(scheduler, &SyncScheduler::syncAboutToBeApplied, this, &RoomListModel::beginTransaction);
+        connect(scheduler, &SyncScheduler::syncApplied, this, &RoomListModel::endTransaction);
+    }
 
     doResetModel();
 
@@ -81,24 +98,87 @@ void RoomListModel::doResetModel()
 {
     beginResetModel();
     m_rooms.clear();
+    m_rows.clear();
+    m_pendingChanges.clear();
+    resetCounts();
     const auto rooms = m_connection->allRooms();
     for (const auto &room : rooms) {
         doAddRoom(room);
     }
+    if (m_placeholders.isEmpty()) {
+        if (auto hydrator = m_connection->findChild<StateHydrator *>(); hydrator && !hydrator->isFinished()) {
+            m_placeholders = hydrator->pendingSummaries();
+        }
+    }
+    // The placeholders of the rooms loaded so far are replaced by them
+    m_placeholders.erase(std::remove_if(m_placeholders.begin(),
+                                        m_placeholders.end(),
+                                        [this](const RoomSummary &row) {
+                                            return m_connection->room(row.id, JoinState::Join | JoinState::Invite | JoinState::Leave);
+                                        }),
+                         m_placeholders.end());
     endResetModel();
-    refreshNotificationCount();
+}
+
+void RoomListModel::loadSummaries(const QString &userId)
+{
+    if (m_connection) {
+        return;
+    }
+    RoomSummaryIndex index;
+    if (!index.load(RoomSummaryIndex::fileName(userId))) {
+        return;
+    }
+    beginResetModel();
+    m_accountId = userId;
+    m_placeholders.clear();
+    const auto summaries = index.summaries();
+    m_placeholders.reserve(summaries.size());
+    for (const auto &summary : summaries) {
+        m_placeholders += summary;
+    }
+    endResetModel();
+}
+
+int RoomListModel::placeholderCount() const
+{
+    return m_placeholders.size();
+}
+
+void RoomListModel::removePlaceholder(const QString &roomId)
+{
+    for (int i = 0; i < m_placeholders.size(); ++i) {
+        if (m_placeholders[i].id == roomId) {
+            beginRemoveRows(QModelIndex(), m_rooms.size() + i, m_rooms.size() + i);
+            m_placeholders.removeAt(i);
+            endRemoveRows();
+            return;
+        }
+    }
+}
+
+void RoomListModel::dropPlaceholders()
+{
+    if (m_placeholders.isEmpty()) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), m_rooms.size(), m_rooms.size() + m_placeholders.size() - 1);
+    m_placeholders.clear();
+    endRemoveRows();
 }
 
 NeoChatRoom *RoomListModel::roomAt(int row) const
 {
-    return m_rooms.at(row);
+    return row < m_rooms.size() ? m_rooms.at(row) : nullptr;
 }
 
 void RoomListModel::doAddRoom(Room *r)
 {
     if (auto room = static_cast<NeoChatRoom *>(r)) {
+        m_rows.insert(room, m_rooms.size());
         m_rooms.append(room);
         connectRoomSignals(room);
+        updateCounts(room);
         Q_EMIT roomAdded(room);
     } else {
         qCritical() << "Attempt to add nullptr to the room list";
@@ -109,27 +189,34 @@ void RoomListModel::doAddRoom(Room *r)
 void RoomListModel::connectRoomSignals(NeoChatRoom *room)
 {
     connect(room, &Room::displaynameChanged, this, [=] {
-        refresh(room);
+        refresh(room, {NameRole});
     });
     connect(room, &Room::unreadMessagesChanged, this, [=] {
-        refresh(room);
+        updateCounts(room);
+        refresh(room, {UnreadCountRole});
     });
-    connect(room, &Room::notificationCountChanged, this, [=] {
-        refresh(room);
+    connect(room, &Room::highlightCountChanged, this, [=] {
+        updateCounts(room);
+        refresh(room, {HighlightCountRole});
     });
     connect(room, &Room::avatarChanged, this, [this, room] {
         refresh(room, {AvatarRole});
     });
     connect(room, &Room::tagsChanged, this, [=] {
-        refresh(room);
+        updateCounts(room);
+        refresh(room, {CategoryRole});
     });
     connect(room, &Room::joinStateChanged, this, [=] {
-        refresh(room);
+        updateCounts(room);
+        refresh(room, {CategoryRole, JoinStateRole});
     });
     connect(room, &Room::addedMessages, this, [=] {
-        refresh(room, {LastEventRole});
+        refresh(room, {LastEventRole, LastActiveTimeRole});
     });
     connect(room, &Room::notificationCountChanged, this, [=] {
+        updateCounts(room);
+        refresh(room, {NotificationCountRole});
+
         if (room->notificationCount() == 0) {
             return;
         }
@@ -173,17 +260,85 @@ void RoomListModel::connectRoomSignals(NeoChatRoom *room)
         }
         Q_EMIT newHighlight(room->id(), lastEvent->id(), room->displayName(), sender->displayname(), room->eventToString(*lastEvent), room->avatar(128));
     });
-    connect(room, &Room::notificationCountChanged, this, &RoomListModel::refreshNotificationCount);
 }
 
-void RoomListModel::refreshNotificationCount()
+RoomType::Types RoomListModel::category(NeoChatRoom *room)
+{
+    if (room->joinState() == JoinState::Invite) {
+        return RoomType::Invited;
+    }
+    if (room->isFavourite()) {
+        return RoomType::Favorite;
+    }
+    if (room->isDirectChat()) {
+        return RoomType::Direct;
+    }
+    if (room->isLowPriority()) {
+        return RoomType::Deprioritized;
+    }
+    return RoomType::Normal;
+}
+
+void RoomListModel::updateCounts(NeoChatRoom *room)
+{
+    const auto it = m_roomCounts.find(room);
+    if (it != m_roomCounts.end()) {
+        addCounts(*it, -1);
+    }
+
+    RoomCounts counts;
+    counts.category = category(room);
+    counts.notifications = room->notificationCount();
+    counts.highlights = room->highlightCount();
+    counts.unread = room->hasUnreadMessages() && !room->readMarkerPending();
+    m_roomCounts.insert(room, counts);
+    addCounts(counts, 1);
+}
+
+void RoomListModel::resetCounts()
+{
+    m_roomCounts.clear();
+    m_notificationCount = 0;
+    m_highlightCount = 0;
+    m_invitationCount = 0;
+    m_unreadRoomCount = 0;
+    m_categoryNotificationCounts.clear();
+    m_categoryHighlightCounts.clear();
+    m_countersTimer.start();
+}
+
+void RoomListModel::removeCounts(const Room *room)
+{
+    const auto it = m_roomCounts.find(room);
+    if (it == m_roomCounts.end()) {
+        return;
+    }
+    addCounts(*it, -1);
+    m_roomCounts.erase(it);
+}
+
+void RoomListModel::addCounts(const RoomCounts &counts, int sign)
 {
-    int count = 0;
-    for (auto room : qAsConst(m_rooms)) {
-        count += room->notificationCount();
+    m_notificationCount += sign * counts.notifications;
+    m_highlightCount += sign * counts.highlights;
+    m_invitationCount += sign * (counts.category == RoomType::Invited ? 1 : 0);
+    m_unreadRoomCount += sign * (counts.unread ? 1 : 0);
+    m_categoryNotificationCounts[counts.category] += sign * counts.notifications;
+    m_categoryHighlightCounts[counts.category] += sign * counts.highlights;
+
+    if (!m_countersTimer.isActive()) {
+        m_countersTimer.start();
     }
-    m_notificationCount = count;
-    Q_EMIT notificationCountChanged();
+}
+
+int RoomListModel::categoryNotificationCount(int category) const
+{
+    return m_categoryNotificationCounts.value(category);
+}
+
+int RoomListModel::categoryHighlightCount(int category) const
+{
+    return m_categoryHighlightCounts.value(category);
 }
 
 void RoomListModel::updateRoom(Room *room, Room *prev)
@@ -203,19 +358,25 @@ void RoomListModel::updateRoom(Room *room, Room *prev)
     }
     // Ok, we're through with pre-checks, now for the real thing.
     auto newRoom = static_cast<NeoChatRoom *>(room);
-    const auto it = std::find_if(m_rooms.begin(), m_rooms.end(), [=](const NeoChatRoom *r) {
-        return r == prev || r == newRoom;
-    });
-    if (it != m_rooms.end()) {
-        const int row = it - m_rooms.begin();
+    int row = prev ? rowOf(prev) : -1;
+    if (row < 0) {
+        row = rowOf(newRoom);
+    }
+    if (row >= 0) {
         // There's no guarantee that prev != newRoom
-        if (*it == prev && *it != newRoom) {
+        if (m_rooms[row] == prev && prev != newRoom) {
             prev->disconnect(this);
+            m_rows.remove(prev);
+            m_pendingChanges.remove(static_cast<NeoChatRoom *>(prev));
+            removeCounts(prev);
             m_rooms.replace(row, newRoom);
+            m_rows.insert(newRoom, row);
             connectRoomSignals(newRoom);
         }
-        Q_EMIT dataChanged(index(row), index(row));
+        updateCounts(newRoom);
+        refresh(newRoom);
     } else {
+        removePlaceholder(newRoom->id());
         beginInsertRows(QModelIndex(), m_rooms.count(), m_rooms.count());
         doAddRoom(newRoom);
         endInsertRows();
@@ -225,14 +386,20 @@ void RoomListModel::updateRoom(Room *room, Room *prev)
 void RoomListModel::deleteRoom(Room *room)
 {
     qDebug() << "Deleting room" << room->id();
-    const auto it = std::find(m_rooms.begin(), m_rooms.end(), room);
-    if (it == m_rooms.end()) {
+    const int row = rowOf(room);
+    if (row < 0) {
         return; // Already deleted, nothing to do
     }
     qDebug() << "Erasing room" << room->id();
-    const int row = it - m_rooms.begin();
+    // The counters are up to date by the time views see the row go
+    removeCounts(room);
     beginRemoveRows(QModelIndex(), row, row);
-    m_rooms.erase(it);
+    m_rooms.removeAt(row);
+    m_rows.remove(room);
+    m_pendingChanges.remove(static_cast<NeoChatRoom *>(room));
+    for (int i = row; i < m_rooms.size(); ++i) {
+        m_rows[m_rooms[i]] = i;
+    }
     endRemoveRows();
 }
 
@@ -241,7 +408,7 @@ int RoomListModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid()) {
         return 0;
     }
-    return m_rooms.count();
+    return m_rooms.count() + m_placeholders.size();
 }
 
 QVariant RoomListModel::data(const QModelIndex &index, int role) const
@@ -250,10 +417,43 @@ QVariant RoomListModel::data(const QModelIndex &index, int role) const
         return QVariant();
     }
 
-    if (index.row() >= m_rooms.count()) {
+    if (index.row() >= rowCount()) {
         qDebug() << "UserListModel: something wrong here...";
         return QVariant();
     }
+    if (index.row() >= m_rooms.count()) {
+        const auto &row = m_placeholders.at(index.row() - m_rooms.count());
+        switch (role) {
+        case NameRole:
+            return row.name;
+        case AvatarRole:
+            return row.avatarMediaId;
+        case TopicRole:
+            return QString();
+        case CategoryRole:
+            return row.category;
+        case UnreadCountRole:
+            return row.unreadCount;
+        case NotificationCountRole:
+            return row.notificationCount;
+        case HighlightCountRole:
+            return row.highlightCount;
+        case LastEventRole:
+            return row.lastEvent;
+        case LastActiveTimeRole:
+            return QDateTime::fromMSecsSinceEpoch(row.lastActiveTime);
+        case JoinStateRole:
+            return toCString(JoinState(row.joinState));
+        case CurrentRoomRole:
+            return QVariant::fromValue<NeoChatRoom *>(nullptr);
+        case RoomIdRole:
+            return row.id;
+        case AccountRole:
+            return m_accountId;
+        default:
+            return QVariant();
+        }
+    }
     NeoChatRoom *room = m_rooms.at(index.row());
     if (role == NameRole) {
         return room->displayName();
@@ -265,22 +465,10 @@ QVariant RoomListModel::data(const QModelIndex &index, int role) const
         return room->topic();
     }
     if (role == CategoryRole) {
-        if (room->joinState() == JoinState::Invite) {
-            return RoomType::Invited;
-        }
-        if (room->isFavourite()) {
-            return RoomType::Favorite;
-        }
-        if (room->isDirectChat()) {
-            return RoomType::Direct;
-        }
-        if (room->isLowPriority()) {
-            return RoomType::Deprioritized;
-        }
-        return RoomType::Normal;
+        return category(room);
     }
     if (role == UnreadCountRole) {
-        return room->unreadCount();
+        return room->readMarkerPending() ? -1 : room->unreadCount();
     }
     if (role == NotificationCountRole) {
         return room->notificationCount();
@@ -303,24 +491,87 @@ QVariant RoomListModel::data(const QModelIndex &index, int role) const
     if (role == CurrentRoomRole) {
         return QVariant::fromValue(room);
     }
-    if (role == CategoryVisibleRole) {
-        return m_categoryVisibility.value(data(index, CategoryRole).toInt(), true);
+    if (role == RoomIdRole) {
+        return room->id();
+    }
+    if (role == AccountRole) {
+        return m_accountId;
     }
     return QVariant();
 }
 
 void RoomListModel::refresh(NeoChatRoom *room, const QVector<int> &roles)
 {
-    const auto it = std::find(m_rooms.begin(), m_rooms.end(), room);
-    if (it == m_rooms.end()) {
+    const int row = rowOf(room);
+    if (row < 0) {
         qCritical() << "Room" << room->id() << "not found in the room list";
         return;
     }
-    const auto idx = index(it - m_rooms.begin());
+    if (m_transactionDepth > 0) {
+        const auto it = m_pendingChanges.find(room);
+        if (it == m_pendingChanges.end()) {
+            m_pendingChanges.insert(room, roles);
+        } else if (roles.isEmpty()) {
+            it->clear();
+        } else if (!it->isEmpty()) {
+            for (const auto role : roles) {
+                if (!it->contains(role)) {
+                    it->append(role);
+                }
+            }
+        }
+        return;
+    }
+    const auto idx = index(row);
     Q_EMIT dataChanged(idx, idx, roles);
 }
 
+void RoomListModel::beginTransaction()
+{
+    ++m_transactionDepth;
+}
+
+void RoomListModel::endTransaction()
+{
+    if (m_transactionDepth == 0 || --m_transactionDepth > 0 || m_pendingChanges.isEmpty()) {
+        return;
+    }
+
+    QVector<QPair<int, QVector<int>>> changes;
+    changes.reserve(m_pendingChanges.size());
+    for (auto it = m_pendingChanges.begin(); it != m_pendingChanges.end(); ++it) {
+        std::sort(it->begin(), it->end());
+        changes.append({rowOf(it.key()), *it});
+    }
+    m_pendingChanges.clear();
+    std::sort(changes.begin(), changes.end(), [](const QPair<int, QVector<int>> &left, const QPair<int, QVector<int>> &right) {
+        return left.first < right.first;
+    });
+
+    // One range per run of adjacent rows with the same changed roles
+    Q_EMIT aboutToCommitTransaction();
+    for (int first = 0; first < changes.size();) {
+        int last = first;
+        while (last + 1 < changes.size() && changes[last + 1].first == changes[last].first + 1 && changes[last + 1].second == changes[first].second) {
+            ++last;
+        }
+        Q_EMIT dataChanged(index(changes[first].first), index(changes[last].first), changes[first].second);
+        first = last + 1;
+    }
+    Q_EMIT transactionCommitted();
+}
+
+int RoomListModel::rowOf(const Room *room) const
+{
+    return m_rows.value(room, -1);
+}
+
 QHash<int, QByteArray> RoomListModel::roleNames() const
+{
+    return roomRoleNames();
+}
+
+QHash<int, QByteArray> RoomListModel::roomRoleNames()
 {
     QHash<int, QByteArray> roles;
     roles[NameRole] = "name";
@@ -334,7 +585,8 @@ QHash<int, QByteArray> RoomListModel::roleNames() const
     roles[LastActiveTimeRole] = "lastActiveTime";
     roles[JoinStateRole] = "joinState";
     roles[CurrentRoomRole] = "currentRoom";
-    roles[CategoryVisibleRole] = "categoryVisible";
+    roles[RoomIdRole] = "roomId";
+    roles[AccountRole] = "account";
     return roles;
 }
 
@@ -355,24 +607,3 @@ QString RoomListModel::categoryName(int section)
         return i18n("Deadbeef");
     }
 }
-
-void RoomListModel::setCategoryVisible(int category, bool visible)
-{
-    beginResetModel();
-    auto collapsedSections = NeoChatConfig::collapsedSections();
-    if (visible) {
-        collapsedSections.removeAll(category);
-    } else {
-        collapsedSections.push_back(category);
-    }
-    NeoChatConfig::setCollapsedSections(collapsedSections);
-    NeoChatConfig::self()->save();
-
-    m_categoryVisibility[category] = visible;
-    endResetModel();
-}
-
-bool RoomListModel::categoryVisible(int category) const
-{
-    return m_categoryVisibility.value(category, true);
-}
@@ -12,6 +12,9 @@
 #include "room.h"
 
 #include <QAbstractListModel>
+#include <QTimer>
+
+#include "roomsummaryindex.h"
 
 using namespace Quotient;
 
@@ -35,6 +38,9 @@ class RoomListModel : public QAbstractListModel
     Q_OBJECT
     Q_PROPERTY(Connection *connection READ connection WRITE setConnection NOTIFY connectionChanged)
     Q_PROPERTY(int notificationCount READ notificationCount NOTIFY notificationCountChanged)
+    Q_PROPERTY(int highlightCount READ highlightCount NOTIFY notificationCountChanged)
+    Q_PROPERTY(int invitationCount READ invitationCount NOTIFY notificationCountChanged)
+    Q_PROPERTY(int unreadRoomCount READ unreadRoomCount NOTIFY notificationCountChanged)
 
 public:
     enum EventRoles {
@@ -48,8 +54,11 @@ public:
         LastEventRole,
         LastActiveTimeRole,
         JoinStateRole,
+        /// Null for placeholder rows
         CurrentRoomRole,
-        CategoryVisibleRole,
+        RoomIdRole,
+        /// User ID of the account the room belongs to
+        AccountRole,
     };
     Q_ENUM(EventRoles)
 
@@ -63,42 +72,110 @@ public:
     void setConnection(Connection *connection);
     void doResetModel();
 
+    /// Show the rooms of the summary index of the account until it is connected.
+    ///
+    /// The summary rows follow the rooms; each is replaced by its room once
+    /// that is loaded and the remaining ones are dropped after the first
+    /// sync. Only has an effect before a connection is set. Once it is set,
+    /// the rooms whose cached state is still being loaded by the
+    /// StateHydrator of the connection are shown from the summary index.
+    void loadSummaries(const QString &userId);
+    [[nodiscard]] int placeholderCount() const;
+
+    /// Null for placeholder rows
     Q_INVOKABLE [[nodiscard]] NeoChatRoom *roomAt(int row) const;
 
     [[nodiscard]] QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     Q_INVOKABLE [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
     [[nodiscard]] QHash<int, QByteArray> roleNames() const override;
+    /// The role names, for models forwarding the roles of room list models
+    [[nodiscard]] static QHash<int, QByteArray> roomRoleNames();
 
     Q_INVOKABLE [[nodiscard]] static QString categoryName(int section);
-    Q_INVOKABLE void setCategoryVisible(int category, bool visible);
-    Q_INVOKABLE [[nodiscard]] bool categoryVisible(int category) const;
+    [[nodiscard]] static RoomType::Types category(NeoChatRoom *room);
+
+    /// Row of the room, -1 if it isn't in the list
+    [[nodiscard]] int rowOf(const Quotient::Room *room) const;
 
+    /// The counters are updated with the difference each time a room changes
+    /// and notificationCountChanged() is emitted at most once per event loop
+    /// iteration, so once for a whole sync.
     [[nodiscard]] int notificationCount() const
     {
         return m_notificationCount;
     }
+    [[nodiscard]] int highlightCount() const
+    {
+        return m_highlightCount;
+    }
+    [[nodiscard]] int invitationCount() const
+    {
+        return m_invitationCount;
+    }
+    [[nodiscard]] int unreadRoomCount() const
+    {
+        return m_unreadRoomCount;
+    }
+    Q_INVOKABLE [[nodiscard]] int categoryNotificationCount(int category) const;
+    Q_INVOKABLE [[nodiscard]] int categoryHighlightCount(int category) const;
+
+    /// Collect the changes of the rooms until the matching endTransaction().
+    ///
+    /// The connection's syncs are applied in a transaction. When the
+    /// outermost transaction ends, the changed rows are reported with as few
+    /// dataChanged() ranges as possible, between aboutToCommitTransaction()
+    /// and transactionCommitted() so that proxies can sort once for the batch.
+    void beginTransaction();
+    void endTransaction();
 
 private Q_SLOTS:
     void doAddRoom(Quotient::Room *room);
     void updateRoom(Quotient::Room *room, Quotient::Room *prev);
     void deleteRoom(Quotient::Room *room);
     void refresh(NeoChatRoom *room, const QVector<int> &roles = {});
-    void refreshNotificationCount();
 
 private:
     Connection *m_connection = nullptr;
+    QString m_accountId;
     QList<NeoChatRoom *> m_rooms;
-
-    QMap<int, bool> m_categoryVisibility;
-
+    /// Summaries of the rooms that aren't loaded yet, after m_rooms
+    QVector<RoomSummary> m_placeholders;
+    /// Row of each room in m_rooms, kept in sync with it
+    QHash<const Quotient::Room *, int> m_rows;
+
+    struct RoomCounts {
+        int category = 0;
+        int notifications = 0;
+        int highlights = 0;
+        bool unread = false;
+    };
+    QHash<const Quotient::Room *, RoomCounts> m_roomCounts;
     int m_notificationCount = 0;
+    int m_highlightCount = 0;
+    int m_invitationCount = 0;
+    int m_unreadRoomCount = 0;
+    QHash<int, int> m_categoryNotificationCounts;
+    QHash<int, int> m_categoryHighlightCounts;
+    QTimer m_countersTimer;
+
+    int m_transactionDepth = 0;
+    /// Changed roles of the rooms changed in the current transaction, empty for all roles
+    QHash<NeoChatRoom *, QVector<int>> m_pendingChanges;
 
     void connectRoomSignals(NeoChatRoom *room);
+    void removePlaceholder(const QString &roomId);
+    void dropPlaceholders();
+    void updateCounts(NeoChatRoom *room);
+    void removeCounts(const Quotient::Room *room);
+    void resetCounts();
+    void addCounts(const RoomCounts &counts, int sign);
 
 Q_SIGNALS:
     void connectionChanged();
     void notificationCountChanged();
+    void aboutToCommitTransaction();
+    void transactionCommitted();
 
     void roomAdded(NeoChatRoom *_t1);
     void newMessage(const QString &_t1, const QString &_t2, const QString &_t3, const QString &_t4, const QString &_t5, const QImage &_t6);
@@ -0,0 +1,177 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "roomsearchindex.h"
+
+#include "connection.h"
+#include "room.h"
+#include "user.h"
+
+using namespace Quotient;
+
+static const int NameWeight = 10;
+static const int DirectChatWeight = 9;
+static const int AliasWeight = 8;
+static const int AltAliasWeight = 6;
+static const int TopicWeight = 2;
+
+RoomSearchIndex::RoomSearchIndex(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QString RoomSearchIndex::fold(const QString &text)
+{
+    const auto decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString folded;
+    folded.reserve(decomposed.size());
+    for (const auto c : decomposed) {
+        if (c.category() != QChar::Mark_NonSpacing) {
+            folded += c;
+        }
+    }
+    return folded.toCaseFolded();
+}
+
+void RoomSearchIndex::update(Room *room)
+{
+    if (!m_entries.contains(room)) {
+        connect(room, &Room::namesChanged, this, [this, room] {
+            update(room);
+        });
+        connect(room, &Room::topicChanged, this, [this, room] {
+            update(room);
+        });
+        connect(room, &QObject::destroyed, this, [this, room] {
+            remove(room);
+        });
+    }
+
+    QStringList directChatUsers;
+    if (room->isDirectChat()) {
+        const auto users = room->connection()->directChatUsers(room);
+        for (const auto user : users) {
+            directChatUsers += user->displayname(room);
+            directChatUsers += user->id();
+        }
+    }
+    m_entries.insert(room, fields(room->displayName(), room->canonicalAlias(), room->altAliases(), room->topic(), directChatUsers));
+    Q_EMIT roomUpdated(room);
+}
+
+QVector<RoomSearchIndex::Field>
+RoomSearchIndex::fields(const QString &name, const QString &canonicalAlias, const QStringList &altAliases, const QString &topic, const QStringList &directChatUsers)
+{
+    QVector<Field> fields;
+    fields.append(Field {fold(name), NameWeight, true});
+    if (!canonicalAlias.isEmpty()) {
+        fields.append(Field {fold(canonicalAlias), AliasWeight, true});
+    }
+    for (const auto &alias : altAliases) {
+        fields.append(Field {fold(alias), AltAliasWeight, true});
+    }
+    if (!topic.isEmpty()) {
+        fields.append(Field {fold(topic), TopicWeight, false});
+    }
+    for (const auto &user : directChatUsers) {
+        fields.append(Field {fold(user), DirectChatWeight, true});
+    }
+    return fields;
+}
+
+void RoomSearchIndex::remove(const Room *room)
+{
+    if (m_entries.remove(room) > 0) {
+        disconnect(room, nullptr, this, nullptr);
+    }
+}
+
+void RoomSearchIndex::clear()
+{
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        disconnect(it.key(), nullptr, this, nullptr);
+    }
+    m_entries.clear();
+}
+
+int RoomSearchIndex::matchScore(const Field &field, const QString &term)
+{
+    const int position = field.text.indexOf(term);
+    if (position == 0) {
+        return 100;
+    }
+    if (position > 0) {
+        // Prefer a match at the start of a word anywhere in the field
+        int from = position;
+        while (from >= 0) {
+            if (from > 0 && !field.text[from - 1].isLetterOrNumber()) {
+                return 80;
+            }
+            from = field.text.indexOf(term, from + 1);
+        }
+        return 50;
+    }
+
+    if (!field.subsequence) {
+        return 0;
+    }
+
+    // Subsequence: all characters of the term in order, fewer gaps are better
+    int gaps = 0;
+    int i = 0;
+    for (int j = 0; i < term.size() && j < field.text.size(); ++j) {
+        if (field.text[j] == term[i]) {
+            ++i;
+        } else if (i > 0) {
+            ++gaps;
+        }
+    }
+    if (i < term.size()) {
+        return 0;
+    }
+    return qMax(1, 30 - gaps);
+}
+
+QStringList RoomSearchIndex::searchTerms(const QString &text)
+{
+    return fold(text).split(QLatin1Char(' '), Qt::SkipEmptyParts);
+}
+
+int RoomSearchIndex::score(const QVector<Field> &fields, const QStringList &terms)
+{
+    int score = 0;
+    for (const auto &term : terms) {
+        int termScore = 0;
+        for (const auto &field : fields) {
+            termScore = qMax(termScore, field.weight * matchScore(field, term));
+        }
+        if (termScore == 0) {
+            return 0;
+        }
+        score += termScore;
+    }
+    return score;
+}
+
+int RoomSearchIndex::score(const Room *room, const QStringList &terms) const
+{
+    const auto it = m_entries.constFind(room);
+    return it != m_entries.constEnd() ? score(*it, terms) : 0;
+}
+
+QHash<const Room *, int> RoomSearchIndex::search(const QStringList &terms) const
+{
+    QHash<const Room *, int> scores;
+    if (terms.isEmpty()) {
+        return scores;
+    }
+
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (const int score = RoomSearchIndex::score(it.value(), terms); score > 0) {
+            scores.insert(it.key(), score);
+        }
+    }
+    return scores;
+}
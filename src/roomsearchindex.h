@@ -0,0 +1,70 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+namespace Quotient
+{
+class Room;
+}
+
+/// Searchable text of the rooms of a room list.
+///
+/// Every room is indexed with its display name, canonical alias, alternative
+/// aliases, topic and, for direct chats, the name and id of the other user.
+/// The text is case and diacritic folded when a room changes, so a search only
+/// compares prepared strings. Matches are ranked by the field they were found
+/// in and by how they match: at the start of the field, at the start of a
+/// word, anywhere, or as a subsequence ("nchdev" finds "NeoChat Development").
+/// Topics only match as a substring: they are long, and a subsequence would be
+/// found in most of them.
+class RoomSearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Field {
+        QString text;
+        int weight;
+        bool subsequence;
+    };
+
+    explicit RoomSearchIndex(QObject *parent = nullptr);
+
+    /// Index the room, or index it again after a change.
+    void update(Quotient::Room *room);
+    void remove(const Quotient::Room *room);
+    void clear();
+
+    /// Score of every matching room; rooms that don't match are left out.
+    [[nodiscard]] QHash<const Quotient::Room *, int> search(const QStringList &terms) const;
+    /// Score of one room, 0 if it doesn't match or isn't indexed.
+    [[nodiscard]] int score(const Quotient::Room *room, const QStringList &terms) const;
+
+    /// The folded terms of a search text
+    [[nodiscard]] static QStringList searchTerms(const QString &text);
+    /// Lower case, without diacritics
+    [[nodiscard]] static QString fold(const QString &text);
+
+    /// The indexed fields of a room with the given names and topic
+    [[nodiscard]] static QVector<Field>
+    fields(const QString &name, const QString &canonicalAlias, const QStringList &altAliases, const QString &topic, const QStringList &directChatUsers);
+    /// Score of the fields of a room; every term has to match some field
+    [[nodiscard]] static int score(const QVector<Field> &fields, const QStringList &terms);
+
+Q_SIGNALS:
+    /// The indexed text of the room changed.
+    void roomUpdated(const Quotient::Room *room);
+
+private:
+    QHash<const Quotient::Room *, QVector<Field>> m_entries;
+
+    [[nodiscard]] static int matchScore(const Field &field, const QString &term);
+};
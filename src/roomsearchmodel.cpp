@@ -0,0 +1,156 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "roomsearchmodel.h"
+
+#include "roomlistmodel.h"
+
+RoomSearchModel::RoomSearchModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+    sort(0);
+    connect(&m_index, &RoomSearchIndex::roomUpdated, this, [this](const Quotient::Room *room) {
+        if (rescoreRoom(room)) {
+            invalidate();
+        }
+    });
+}
+
+void RoomSearchModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel()) {
+        this->sourceModel()->disconnect(this);
+    }
+    m_index.clear();
+    m_rooms.clear();
+    m_scores.clear();
+
+    // Connected before the base class connects its own slots, so that the
+    // rooms and scores are up to date when it filters and sorts the rows.
+    if (sourceModel) {
+        connect(sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &, int first, int last) {
+            m_rooms.insert(first, last - first + 1, nullptr);
+            indexRows(first, last);
+        });
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex &, int first, int last) {
+            for (int row = first; row <= last; ++row) {
+                m_index.remove(m_rooms[row]);
+                m_scores.remove(m_rooms[row]);
+            }
+        });
+        connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex &, int first, int last) {
+            m_rooms.remove(first, last - first + 1);
+        });
+        // Display names, tags and direct chat changes all end up here, as
+        // well as placeholder rows that got their room
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+            if (!roles.isEmpty() && !roles.contains(RoomListModel::NameRole) && !roles.contains(RoomListModel::TopicRole)
+                && !roles.contains(RoomListModel::CurrentRoomRole)) {
+                return;
+            }
+            if (indexRows(topLeft.row(), bottomRight.row())) {
+                invalidate();
+            }
+        });
+        connect(sourceModel, &QAbstractItemModel::rowsMoved, this, &RoomSearchModel::resetRows);
+        connect(sourceModel, &QAbstractItemModel::layoutChanged, this, &RoomSearchModel::resetRows);
+        connect(sourceModel, &QAbstractItemModel::modelReset, this, &RoomSearchModel::resetRows);
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+    resetRows();
+}
+
+NeoChatRoom *RoomSearchModel::roomAt(int sourceRow) const
+{
+    return sourceModel()->data(sourceModel()->index(sourceRow, 0), RoomListModel::CurrentRoomRole).value<NeoChatRoom *>();
+}
+
+void RoomSearchModel::resetRows()
+{
+    m_index.clear();
+    m_rooms.clear();
+    if (sourceModel()) {
+        m_rooms.resize(sourceModel()->rowCount());
+        indexRows(0, m_rooms.size() - 1);
+    }
+    rescore();
+}
+
+bool RoomSearchModel::indexRows(int first, int last)
+{
+    // The scores of the rows are computed here, not by the roomUpdated handler
+    const QSignalBlocker blocker(&m_index);
+    bool changed = false;
+    for (int row = first; row <= last; ++row) {
+        const auto room = roomAt(row);
+        if (m_rooms[row] && m_rooms[row] != room) {
+            m_index.remove(m_rooms[row]);
+            changed |= m_scores.remove(m_rooms[row]) > 0;
+        }
+        m_rooms[row] = room;
+        if (room) {
+            m_index.update(room);
+            changed |= rescoreRoom(room);
+        }
+    }
+    return changed;
+}
+
+void RoomSearchModel::setFilterText(const QString &text)
+{
+    if (m_filterText == text) {
+        return;
+    }
+    m_filterText = text;
+    m_terms = RoomSearchIndex::searchTerms(text);
+    rescore();
+    Q_EMIT filterTextChanged();
+}
+
+QString RoomSearchModel::filterText() const
+{
+    return m_filterText;
+}
+
+void RoomSearchModel::rescore()
+{
+    m_scores = m_index.search(m_terms);
+    invalidate();
+}
+
+bool RoomSearchModel::rescoreRoom(const Quotient::Room *room)
+{
+    if (!room || m_terms.isEmpty()) {
+        return false;
+    }
+    const int score = m_index.score(room, m_terms);
+    const auto it = m_scores.find(room);
+    if (it == m_scores.end() ? score == 0 : *it == score) {
+        return false;
+    }
+    if (score > 0) {
+        m_scores.insert(room, score);
+    } else {
+        m_scores.erase(it);
+    }
+    return true;
+}
+
+bool RoomSearchModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+{
+    Q_UNUSED(source_parent);
+    const auto room = m_rooms.value(source_row);
+    return room && room->successorId().isEmpty() && m_scores.contains(room);
+}
+
+bool RoomSearchModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
+{
+    const auto left = m_scores.value(m_rooms.value(source_left.row()));
+    const auto right = m_scores.value(m_rooms.value(source_right.row()));
+    if (left != right) {
+        return left > right;
+    }
+    return source_left.row() < source_right.row();
+}
@@ -0,0 +1,57 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QSortFilterProxyModel>
+
+#include "roomsearchindex.h"
+
+/// Rooms of a RoomListModel matching a search text, best matches first.
+///
+/// The room of every source row is read once when the row is inserted, and
+/// the scores of the rooms are kept for the current search text. When a room
+/// changes, only its score is computed again, and the rows are only filtered
+/// and sorted again when it differs.
+///
+/// \see RoomSearchIndex
+class RoomSearchModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString filterText READ filterText WRITE setFilterText NOTIFY filterTextChanged)
+
+public:
+    explicit RoomSearchModel(QObject *parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+
+    void setFilterText(const QString &text);
+    [[nodiscard]] QString filterText() const;
+
+    [[nodiscard]] bool lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const override;
+
+protected:
+    [[nodiscard]] bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
+
+Q_SIGNALS:
+    void filterTextChanged();
+
+private:
+    RoomSearchIndex m_index;
+    QString m_filterText;
+    QStringList m_terms;
+    /// Indexed by source row; null for placeholder rows
+    QVector<NeoChatRoom *> m_rooms;
+    /// Score of every matching room for the current search text
+    QHash<const Quotient::Room *, int> m_scores;
+
+    /// Read the rooms of the source rows and index them; returns whether a score changed
+    bool indexRows(int first, int last);
+    void resetRows();
+    void rescore();
+    /// Compute the score of a room again; returns whether it changed
+    bool rescoreRoom(const Quotient::Room *room);
+    [[nodiscard]] NeoChatRoom *roomAt(int sourceRow) const;
+};
@@ -0,0 +1,143 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "roomsummaryindex.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+
+#include "neochatroom.h"
+#include "roomlistmodel.h"
+
+static const quint32 IndexMagic = 0x4e435253; // "NCRS"
+static const quint32 IndexVersion = 2;
+
+QDataStream &operator<<(QDataStream &stream, const RoomSummary &summary)
+{
+    return stream << summary.id << summary.name << summary.avatarMediaId << summary.lastEvent << summary.tags << summary.lastActiveTime << qint32(summary.unreadCount)
+                  << qint32(summary.notificationCount) << qint32(summary.highlightCount) << qint32(summary.joinState) << qint32(summary.category);
+}
+
+QDataStream &operator>>(QDataStream &stream, RoomSummary &summary)
+{
+    qint32 unreadCount;
+    qint32 notificationCount;
+    qint32 highlightCount;
+    qint32 joinState;
+    qint32 category;
+    stream >> summary.id >> summary.name >> summary.avatarMediaId >> summary.lastEvent >> summary.tags >> summary.lastActiveTime >> unreadCount >> notificationCount
+        >> highlightCount >> joinState >> category;
+    summary.unreadCount = unreadCount;
+    summary.notificationCount = notificationCount;
+    summary.highlightCount = highlightCount;
+    summary.joinState = joinState;
+    summary.category = category;
+    return stream;
+}
+
+QString RoomSummaryIndex::fileName(const QString &userId)
+{
+    return QStringLiteral("%1/room_list/%2").arg(QStandardPaths::writableLocation(QStandardPaths::CacheLocation), QString::fromLatin1(QUrl::toPercentEncoding(userId)));
+}
+
+bool RoomSummaryIndex::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const auto size = file.size();
+    const auto data = file.map(0, size);
+    if (!data) {
+        return false;
+    }
+
+    // The strings are copied out of the mapping while the summaries are read
+    const auto bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(data), int(size));
+    QDataStream stream(bytes);
+    quint32 magic;
+    quint32 version;
+    stream >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion) {
+        qWarning() << "Ignoring room summary index with unknown format" << fileName;
+        return false;
+    }
+    stream.setVersion(QDataStream::Qt_5_15);
+
+    QHash<QString, RoomSummary> summaries;
+    stream >> summaries;
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "Room summary index is corrupted" << fileName;
+        return false;
+    }
+    m_summaries = summaries;
+    return true;
+}
+
+bool RoomSummaryIndex::save(const QString &fileName) const
+{
+    const auto dir = QFileInfo(fileName).dir();
+    if (!dir.exists() && !dir.mkpath(QStringLiteral("."))) {
+        return false;
+    }
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream << IndexMagic << IndexVersion;
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << m_summaries;
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+void RoomSummaryIndex::update(NeoChatRoom *room)
+{
+    RoomSummary summary;
+    summary.id = room->id();
+    summary.name = room->displayName();
+    summary.avatarMediaId = room->avatarMediaId();
+    summary.lastEvent = room->lastEventToString();
+    summary.tags = room->tagNames();
+    summary.lastActiveTime = room->lastActiveTime().toMSecsSinceEpoch();
+    summary.unreadCount = room->unreadCount();
+    summary.notificationCount = room->notificationCount();
+    summary.highlightCount = room->highlightCount();
+    summary.joinState = int(room->joinState());
+    summary.category = RoomListModel::category(room);
+    m_summaries.insert(summary.id, summary);
+}
+
+void RoomSummaryIndex::remove(const QString &roomId)
+{
+    m_summaries.remove(roomId);
+}
+
+bool RoomSummaryIndex::isEmpty() const
+{
+    return m_summaries.isEmpty();
+}
+
+bool RoomSummaryIndex::contains(const QString &roomId) const
+{
+    return m_summaries.contains(roomId);
+}
+
+RoomSummary RoomSummaryIndex::summary(const QString &roomId) const
+{
+    return m_summaries.value(roomId);
+}
+
+QHash<QString, RoomSummary> RoomSummaryIndex::summaries() const
+{
+    return m_summaries;
+}
@@ -0,0 +1,60 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+class NeoChatRoom;
+class QDataStream;
+
+/// What the room list needs to know about a room without loading its state.
+struct RoomSummary {
+    QString id;
+    QString name;
+    QString avatarMediaId;
+    QString lastEvent;
+    QStringList tags;
+    qint64 lastActiveTime = 0;
+    int unreadCount = -1;
+    int notificationCount = 0;
+    int highlightCount = 0;
+    int joinState = 0;
+    /// RoomType::Types
+    int category = 0;
+};
+
+QDataStream &operator<<(QDataStream &stream, const RoomSummary &summary);
+QDataStream &operator>>(QDataStream &stream, RoomSummary &summary);
+
+/// Compact per-account index of room summaries.
+///
+/// StatePersister keeps it up to date with the rooms that changed. On startup
+/// it lets the room list show the rooms of the account before the account is
+/// connected, and lets StateHydrator decide which rooms to load first before
+/// any room state has been parsed. The file is memory-mapped while it is read
+/// so that loading it costs little more than parsing the summaries.
+class RoomSummaryIndex
+{
+public:
+    /// Location of the index of the account, which is known before the account is connected.
+    [[nodiscard]] static QString fileName(const QString &userId);
+
+    [[nodiscard]] bool load(const QString &fileName);
+    [[nodiscard]] bool save(const QString &fileName) const;
+
+    void update(NeoChatRoom *room);
+    void remove(const QString &roomId);
+
+    [[nodiscard]] bool isEmpty() const;
+    [[nodiscard]] bool contains(const QString &roomId) const;
+    [[nodiscard]] RoomSummary summary(const QString &roomId) const;
+    [[nodiscard]] QHash<QString, RoomSummary> summaries() const;
+
+private:
+    QHash<QString, RoomSummary> m_summaries;
+};
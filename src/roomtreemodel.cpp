@@ -0,0 +1,415 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "roomtreemodel.h"
+
+#include <algorithm>
+
+#include "accountfiltermodel.h"
+#include "mergedroomlistmodel.h"
+#include "neochatconfig.h"
+#include "roomlistmodel.h"
+
+static const int SaveDelay = 1000;
+
+RoomTreeModel::RoomTreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+    const auto collapsedSections = NeoChatConfig::collapsedSections();
+    for (auto collapsedSection : collapsedSections) {
+        m_collapsed += collapsedSection;
+    }
+
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(SaveDelay);
+    connect(&m_saveTimer, &QTimer::timeout, this, &RoomTreeModel::saveCollapsedCategories);
+}
+
+QAbstractItemModel *RoomTreeModel::sourceModel() const
+{
+    return m_sourceModel;
+}
+
+void RoomTreeModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (sourceModel == m_sourceModel) {
+        return;
+    }
+    if (m_sourceModel) {
+        m_sourceModel->disconnect(this);
+    }
+    m_sourceModel = sourceModel;
+
+    if (m_sourceModel) {
+        connect(m_sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &, int first, int last) {
+            for (int row = first; row <= last; ++row) {
+                const auto key = keyOf(row);
+                m_sourceIndexes.insert(key, m_sourceModel->index(row, 0));
+                addRoom(key);
+            }
+        });
+        connect(m_sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex &, int first, int last) {
+            for (int row = last; row >= first; --row) {
+                const auto key = keyOf(row);
+                removeRoom(key);
+                m_sourceIndexes.remove(key);
+            }
+        });
+        connect(m_sourceModel, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+            for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+                updateRoom(keyOf(row), roles);
+            }
+        });
+        connect(m_sourceModel, &QAbstractItemModel::modelReset, this, &RoomTreeModel::reset);
+    }
+    reset();
+    Q_EMIT sourceModelChanged();
+}
+
+void RoomTreeModel::reset()
+{
+    beginResetModel();
+    m_categories.clear();
+    m_sourceIndexes.clear();
+    m_roomCategories.clear();
+    m_lastActive.clear();
+    if (m_sourceModel) {
+        for (int row = 0; row < m_sourceModel->rowCount(); ++row) {
+            const auto key = keyOf(row);
+            const auto sourceIndex = m_sourceModel->index(row, 0);
+            m_sourceIndexes.insert(key, sourceIndex);
+            const int category = sourceIndex.data(RoomListModel::CategoryRole).toInt();
+            m_roomCategories[key] = category;
+            m_lastActive[key] = lastActiveOf(sourceIndex);
+
+            int categoryRow = this->categoryRow(category);
+            if (categoryRow < 0) {
+                m_categories += Category {category, {}};
+                categoryRow = m_categories.size() - 1;
+            }
+            m_categories[categoryRow].rooms += key;
+        }
+        std::sort(m_categories.begin(), m_categories.end(), [](const Category &left, const Category &right) {
+            return left.category < right.category;
+        });
+        for (auto &category : m_categories) {
+            std::stable_sort(category.rooms.begin(), category.rooms.end(), [this](const Key &left, const Key &right) {
+                return m_lastActive[left] > m_lastActive[right];
+            });
+        }
+    }
+    endResetModel();
+}
+
+RoomTreeModel::Key RoomTreeModel::keyOf(int sourceRow) const
+{
+    const auto sourceIndex = m_sourceModel->index(sourceRow, 0);
+    return {sourceIndex.data(RoomListModel::AccountRole).toString(), sourceIndex.data(RoomListModel::RoomIdRole).toString()};
+}
+
+qint64 RoomTreeModel::lastActiveOf(const QModelIndex &sourceIndex)
+{
+    return sourceIndex.data(RoomListModel::LastActiveTimeRole).toDateTime().toMSecsSinceEpoch();
+}
+
+int RoomTreeModel::categoryRow(int category) const
+{
+    for (int row = 0; row < m_categories.size(); ++row) {
+        if (m_categories[row].category == category) {
+            return row;
+        }
+    }
+    return -1;
+}
+
+int RoomTreeModel::insertPosition(const Category &category, const Key &key) const
+{
+    // Most recently active first; after rooms with the same activity
+    const auto lastActive = m_lastActive.value(key);
+    const auto it = std::upper_bound(category.rooms.begin(), category.rooms.end(), lastActive, [this](qint64 value, const Key &other) {
+        return value > m_lastActive.value(other);
+    });
+    return int(it - category.rooms.begin());
+}
+
+int RoomTreeModel::positionOf(const Category &category, const Key &key) const
+{
+    const auto lastActiveIt = m_lastActive.constFind(key);
+    if (lastActiveIt == m_lastActive.constEnd()) {
+        return -1;
+    }
+    const auto lastActive = *lastActiveIt;
+    auto it = std::lower_bound(category.rooms.begin(), category.rooms.end(), lastActive, [this](const Key &other, qint64 value) {
+        return m_lastActive.value(other) > value;
+    });
+    for (; it != category.rooms.end() && m_lastActive.value(*it) == lastActive; ++it) {
+        if (*it == key) {
+            return int(it - category.rooms.begin());
+        }
+    }
+    return -1;
+}
+
+void RoomTreeModel::addRoom(const Key &key)
+{
+    const auto sourceIndex = m_sourceIndexes.value(key);
+    const int category = sourceIndex.data(RoomListModel::CategoryRole).toInt();
+    m_roomCategories[key] = category;
+    m_lastActive[key] = lastActiveOf(sourceIndex);
+
+    int row = categoryRow(category);
+    if (row < 0) {
+        row = int(std::upper_bound(m_categories.begin(), m_categories.end(), category, [](int value, const Category &other) {
+                      return value < other.category;
+                  })
+                  - m_categories.begin());
+        beginInsertRows({}, row, row);
+        m_categories.insert(row, Category {category, {key}});
+        endInsertRows();
+        return;
+    }
+
+    auto &rooms = m_categories[row].rooms;
+    const int position = insertPosition(m_categories[row], key);
+    const bool expanded = !m_collapsed.contains(category);
+    if (expanded) {
+        beginInsertRows(index(row, 0), position, position);
+    }
+    rooms.insert(position, key);
+    if (expanded) {
+        endInsertRows();
+    }
+    Q_EMIT dataChanged(index(row, 0), index(row, 0), {RoomCountRole, RoomListModel::NotificationCountRole, RoomListModel::HighlightCountRole});
+}
+
+void RoomTreeModel::removeRoom(const Key &key)
+{
+    const int row = categoryRow(m_roomCategories.take(key));
+    const int position = row >= 0 ? positionOf(m_categories[row], key) : -1;
+    m_lastActive.remove(key);
+    if (position < 0) {
+        return;
+    }
+
+    auto &rooms = m_categories[row].rooms;
+    if (rooms.size() == 1) {
+        beginRemoveRows({}, row, row);
+        m_categories.removeAt(row);
+        endRemoveRows();
+        return;
+    }
+
+    const bool expanded = !m_collapsed.contains(m_categories[row].category);
+    if (expanded) {
+        beginRemoveRows(index(row, 0), position, position);
+    }
+    rooms.removeAt(position);
+    if (expanded) {
+        endRemoveRows();
+    }
+    Q_EMIT dataChanged(index(row, 0), index(row, 0), {RoomCountRole, RoomListModel::NotificationCountRole, RoomListModel::HighlightCountRole});
+}
+
+void RoomTreeModel::updateRoom(const Key &key, const QVector<int> &roles)
+{
+    const auto sourceIndex = m_sourceIndexes.value(key);
+    const int category = sourceIndex.data(RoomListModel::CategoryRole).toInt();
+    const auto categoryIt = m_roomCategories.constFind(key);
+    if (categoryIt == m_roomCategories.constEnd()) {
+        return;
+    }
+    if (category != *categoryIt) {
+        removeRoom(key);
+        addRoom(key);
+        return;
+    }
+
+    const int row = categoryRow(category);
+    int position = row >= 0 ? positionOf(m_categories[row], key) : -1;
+    if (position < 0) {
+        return;
+    }
+    auto &rooms = m_categories[row].rooms;
+    const bool expanded = !m_collapsed.contains(category);
+
+    // Finding the last activity walks the timeline; only do it when it can have changed
+    const bool activityChanged = roles.isEmpty() || roles.contains(RoomListModel::LastActiveTimeRole) || roles.contains(RoomListModel::LastEventRole);
+    const auto lastActive = activityChanged ? lastActiveOf(sourceIndex) : m_lastActive.value(key);
+    if (lastActive != m_lastActive.value(key)) {
+        m_lastActive[key] = lastActive;
+        rooms.removeAt(position);
+        const int newPosition = insertPosition(m_categories[row], key);
+        rooms.insert(position, key);
+
+        if (newPosition != position) {
+            if (expanded) {
+                const auto parent = index(row, 0);
+                beginMoveRows(parent, position, position, parent, newPosition > position ? newPosition + 1 : newPosition);
+            }
+            rooms.move(position, newPosition);
+            if (expanded) {
+                endMoveRows();
+            }
+            position = newPosition;
+        }
+    }
+
+    if (expanded) {
+        const auto child = index(position, 0, index(row, 0));
+        Q_EMIT dataChanged(child, child, roles);
+    }
+    if (roles.isEmpty() || roles.contains(RoomListModel::NotificationCountRole) || roles.contains(RoomListModel::HighlightCountRole)) {
+        Q_EMIT dataChanged(index(row, 0), index(row, 0), {RoomListModel::NotificationCountRole, RoomListModel::HighlightCountRole});
+    }
+}
+
+int RoomTreeModel::categoryCount(int category, int role) const
+{
+    // The source models keep these counters up to date as the rooms change
+    const bool highlights = role == RoomListModel::HighlightCountRole;
+    if (const auto roomListModel = qobject_cast<RoomListModel *>(m_sourceModel)) {
+        return highlights ? roomListModel->categoryHighlightCount(category) : roomListModel->categoryNotificationCount(category);
+    }
+    if (const auto filterModel = qobject_cast<AccountFilterModel *>(m_sourceModel)) {
+        return highlights ? filterModel->categoryHighlightCount(category) : filterModel->categoryNotificationCount(category);
+    }
+    if (const auto mergedModel = qobject_cast<MergedRoomListModel *>(m_sourceModel)) {
+        return highlights ? mergedModel->categoryHighlightCount(category) : mergedModel->categoryNotificationCount(category);
+    }
+    return 0;
+}
+
+void RoomTreeModel::setCategoryExpanded(int category, bool expanded)
+{
+    if (categoryExpanded(category) == expanded) {
+        return;
+    }
+
+    const int row = categoryRow(category);
+    const int count = row >= 0 ? m_categories[row].rooms.size() : 0;
+    if (count > 0) {
+        if (expanded) {
+            beginInsertRows(index(row, 0), 0, count - 1);
+        } else {
+            beginRemoveRows(index(row, 0), 0, count - 1);
+        }
+    }
+    if (expanded) {
+        m_collapsed.remove(category);
+    } else {
+        m_collapsed.insert(category);
+    }
+    if (count > 0) {
+        if (expanded) {
+            endInsertRows();
+        } else {
+            endRemoveRows();
+        }
+    }
+    if (row >= 0) {
+        Q_EMIT dataChanged(index(row, 0), index(row, 0), {ExpandedRole});
+    }
+
+    m_saveTimer.start();
+}
+
+bool RoomTreeModel::categoryExpanded(int category) const
+{
+    return !m_collapsed.contains(category);
+}
+
+void RoomTreeModel::saveCollapsedCategories()
+{
+    QList<int> collapsedSections = m_collapsed.values();
+    std::sort(collapsedSections.begin(), collapsedSections.end());
+    NeoChatConfig::setCollapsedSections(collapsedSections);
+    NeoChatConfig::self()->save();
+}
+
+QModelIndex RoomTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (column != 0 || row < 0) {
+        return {};
+    }
+    if (!parent.isValid()) {
+        return row < m_categories.size() ? createIndex(row, column, quintptr(0)) : QModelIndex();
+    }
+    if (parent.internalId() != 0 || parent.row() >= m_categories.size()) {
+        return {};
+    }
+    const auto &category = m_categories[parent.row()];
+    // Rooms are identified by the category of their parent, which is never 0
+    return row < category.rooms.size() ? createIndex(row, column, quintptr(category.category)) : QModelIndex();
+}
+
+QModelIndex RoomTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == 0) {
+        return {};
+    }
+    const int row = categoryRow(int(child.internalId()));
+    return row >= 0 ? createIndex(row, 0, quintptr(0)) : QModelIndex();
+}
+
+int RoomTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return m_categories.size();
+    }
+    if (parent.internalId() != 0 || parent.row() >= m_categories.size()) {
+        return 0;
+    }
+    const auto &category = m_categories[parent.row()];
+    return m_collapsed.contains(category.category) ? 0 : category.rooms.size();
+}
+
+int RoomTreeModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+QVariant RoomTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return {};
+    }
+
+    if (index.internalId() == 0) {
+        const auto &category = m_categories.at(index.row());
+        switch (role) {
+        case IsCategoryRole:
+            return true;
+        case ExpandedRole:
+            return categoryExpanded(category.category);
+        case RoomCountRole:
+            return category.rooms.size();
+        case RoomListModel::NameRole:
+            return RoomListModel::categoryName(category.category);
+        case RoomListModel::CategoryRole:
+            return category.category;
+        case RoomListModel::NotificationCountRole:
+        case RoomListModel::HighlightCountRole:
+            return categoryCount(category.category, role);
+        default:
+            return {};
+        }
+    }
+
+    if (role == IsCategoryRole) {
+        return false;
+    }
+    const auto &category = m_categories[categoryRow(int(index.internalId()))];
+    return m_sourceIndexes.value(category.rooms.at(index.row())).data(role);
+}
+
+QHash<int, QByteArray> RoomTreeModel::roleNames() const
+{
+    auto roles = m_sourceModel ? m_sourceModel->roleNames() : RoomListModel::roomRoleNames();
+    roles[IsCategoryRole] = "isCategory";
+    roles[ExpandedRole] = "expanded";
+    roles[RoomCountRole] = "roomCount";
+    return roles;
+}
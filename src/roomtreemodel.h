@@ -0,0 +1,93 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QPersistentModelIndex>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+
+/// The rooms of a room list model grouped by category.
+///
+/// Non-empty categories are the top-level rows; their children are the rooms
+/// of the category, most recently active first. A collapsed category keeps
+/// track of its rooms but exposes no children, so collapsing and expanding
+/// only remove and insert the rows of that category. Category rows carry the
+/// aggregated notification and highlight counts of their rooms.
+///
+/// The source can be any model with the roles of RoomListModel, such as a
+/// RoomListModel or an AccountFilterModel. The counts of the categories are
+/// read from the per-category counters of RoomListModel, so only these models
+/// and MergedRoomListModel provide them.
+class RoomTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QAbstractItemModel *sourceModel READ sourceModel WRITE setSourceModel NOTIFY sourceModelChanged)
+
+public:
+    enum Roles {
+        /// True for category rows
+        IsCategoryRole = Qt::UserRole + 100,
+        ExpandedRole,
+        RoomCountRole,
+    };
+    Q_ENUM(Roles)
+
+    explicit RoomTreeModel(QObject *parent = nullptr);
+
+    [[nodiscard]] QAbstractItemModel *sourceModel() const;
+    void setSourceModel(QAbstractItemModel *sourceModel);
+
+    Q_INVOKABLE void setCategoryExpanded(int category, bool expanded);
+    Q_INVOKABLE [[nodiscard]] bool categoryExpanded(int category) const;
+
+    [[nodiscard]] QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    [[nodiscard]] QModelIndex parent(const QModelIndex &child) const override;
+    [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    [[nodiscard]] int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    [[nodiscard]] QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    [[nodiscard]] QHash<int, QByteArray> roleNames() const override;
+
+Q_SIGNALS:
+    void sourceModelChanged();
+
+private:
+    /// A room is identified by its account and its ID
+    using Key = QPair<QString, QString>;
+
+    struct Category {
+        int category;
+        QVector<Key> rooms;
+    };
+
+    QPointer<QAbstractItemModel> m_sourceModel;
+    /// Where the roles of each room are read from
+    QHash<Key, QPersistentModelIndex> m_sourceIndexes;
+    /// Non-empty categories, ordered by category
+    QVector<Category> m_categories;
+    QHash<Key, int> m_roomCategories;
+    /// Last activity in msecs, what the rooms of a category are sorted by
+    QHash<Key, qint64> m_lastActive;
+    QSet<int> m_collapsed;
+    QTimer m_saveTimer;
+
+    void reset();
+    void addRoom(const Key &key);
+    void removeRoom(const Key &key);
+    void updateRoom(const Key &key, const QVector<int> &roles);
+
+    [[nodiscard]] Key keyOf(int sourceRow) const;
+    [[nodiscard]] static qint64 lastActiveOf(const QModelIndex &sourceIndex);
+    [[nodiscard]] int categoryRow(int category) const;
+    [[nodiscard]] int insertPosition(const Category &category, const Key &key) const;
+    /// Position of a room in its category, or -1; found by its last activity
+    [[nodiscard]] int positionOf(const Category &category, const Key &key) const;
+    /// Notification or highlight count of a category, from the counters of the source
+    [[nodiscard]] int categoryCount(int category, int role) const;
+    void saveCollapsedCategories();
+};
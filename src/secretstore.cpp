@@ -0,0 +1,95 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "secretstore.h"
+
+#ifndef Q_OS_ANDROID
+#include <qt5keychain/keychain.h>
+
+#include <QCoreApplication>
+#else
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QTimer>
+#endif
+
+#ifndef Q_OS_ANDROID
+static SecretStore::Error toError(QKeychain::Error error)
+{
+    switch (error) {
+    case QKeychain::NoError:
+        return SecretStore::NoError;
+    case QKeychain::EntryNotFound:
+        return SecretStore::EntryNotFound;
+    default:
+        return SecretStore::OtherError;
+    }
+}
+
+void KeychainSecretStore::readSecret(const QString &key)
+{
+    auto job = new QKeychain::ReadPasswordJob(qAppName(), this);
+    job->setAutoDelete(true);
+    job->setKey(key);
+    connect(job, &QKeychain::Job::finished, this, [this, job, key] {
+        Q_EMIT readFinished(key, job->binaryData(), toError(job->error()), job->errorString());
+    });
+    job->start();
+}
+
+void KeychainSecretStore::writeSecret(const QString &key, const QByteArray &secret)
+{
+    auto job = new QKeychain::WritePasswordJob(qAppName(), this);
+    job->setAutoDelete(true);
+    job->setKey(key);
+    job->setBinaryData(secret);
+    connect(job, &QKeychain::Job::finished, this, [this, job, key] {
+        Q_EMIT writeFinished(key, toError(job->error()), job->errorString());
+    });
+    job->start();
+}
+
+void KeychainSecretStore::deleteSecret(const QString &key)
+{
+    auto job = new QKeychain::DeletePasswordJob(qAppName(), this);
+    job->setAutoDelete(true);
+    job->setKey(key);
+    connect(job, &QKeychain::Job::finished, this, [this, job, key] {
+        Q_EMIT deleteFinished(key, toError(job->error()), job->errorString());
+    });
+    job->start();
+}
+#else
+void KConfigSecretStore::readSecret(const QString &key)
+{
+    KConfig config("neochat_tokens");
+    KConfigGroup tokensGroup(&config, "Tokens");
+    const auto secret = tokensGroup.readEntry(key, QString()).toLatin1();
+    QTimer::singleShot(0, this, [this, key, secret] {
+        Q_EMIT readFinished(key, secret, secret.isEmpty() ? EntryNotFound : NoError, QString());
+    });
+}
+
+void KConfigSecretStore::writeSecret(const QString &key, const QByteArray &secret)
+{
+    KConfig config("neochat_tokens");
+    KConfigGroup tokensGroup(&config, "Tokens");
+    tokensGroup.writeEntry(key, secret);
+    QTimer::singleShot(0, this, [this, key] {
+        Q_EMIT writeFinished(key, NoError, QString());
+    });
+}
+
+void KConfigSecretStore::deleteSecret(const QString &key)
+{
+    KConfig config("neochat_tokens");
+    KConfigGroup tokensGroup(&config, "Tokens");
+    tokensGroup.deleteEntry(key);
+    QTimer::singleShot(0, this, [this, key] {
+        Q_EMIT deleteFinished(key, NoError, QString());
+    });
+}
+#endif
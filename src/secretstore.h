@@ -0,0 +1,66 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QObject>
+
+/// Asynchronous key/value storage for secrets.
+///
+/// Every request is answered by exactly one of the finished signals, and
+/// never from within the call itself. Requests for different keys may be
+/// issued concurrently. Implementations other than the platform one, e.g. an
+/// in-memory store, can be handed to AccessTokenStore.
+class SecretStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Error {
+        NoError,
+        EntryNotFound,
+        OtherError,
+    };
+    Q_ENUM(Error)
+
+    using QObject::QObject;
+
+    virtual void readSecret(const QString &key) = 0;
+    virtual void writeSecret(const QString &key, const QByteArray &secret) = 0;
+    virtual void deleteSecret(const QString &key) = 0;
+
+Q_SIGNALS:
+    void readFinished(const QString &key, const QByteArray &secret, SecretStore::Error error, const QString &errorString);
+    void writeFinished(const QString &key, SecretStore::Error error, const QString &errorString);
+    void deleteFinished(const QString &key, SecretStore::Error error, const QString &errorString);
+};
+
+#ifndef Q_OS_ANDROID
+/// Secrets stored in the system keychain through QtKeychain.
+class KeychainSecretStore : public SecretStore
+{
+    Q_OBJECT
+
+public:
+    using SecretStore::SecretStore;
+
+    void readSecret(const QString &key) override;
+    void writeSecret(const QString &key, const QByteArray &secret) override;
+    void deleteSecret(const QString &key) override;
+};
+#else
+/// Secrets stored in a KConfig file, Android has no keychain available.
+class KConfigSecretStore : public SecretStore
+{
+    Q_OBJECT
+
+public:
+    using SecretStore::SecretStore;
+
+    void readSecret(const QString &key) override;
+    void writeSecret(const QString &key, const QByteArray &secret) override;
+    void deleteSecret(const QString &key) override;
+};
+#endif
@@ -6,25 +6,31 @@
 
 #include "sortfilterroomlistmodel.h"
 
+#include "mergedroomlistmodel.h"
 #include "roomlistmodel.h"
 
+#include <QAbstractProxyModel>
+
+#include <algorithm>
+
 SortFilterRoomListModel::SortFilterRoomListModel(QObject *parent)
     : QSortFilterProxyModel(parent)
 {
+    m_collator.setNumericMode(true);
+    m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+    setSortRole(RoomListModel::LastActiveTimeRole);
     sort(0);
     invalidateFilter();
-    connect(this, &SortFilterRoomListModel::filterTextChanged, this, [this]() {
-        invalidateFilter();
-    });
 }
 
 void SortFilterRoomListModel::setRoomSortOrder(SortFilterRoomListModel::RoomSortOrder sortOrder)
 {
     m_sortOrder = sortOrder;
     Q_EMIT roomSortOrderChanged();
+    // Changes of the sort role make the proxy move the row to its new position
     if (sortOrder == SortFilterRoomListModel::Alphabetical) {
         setSortRole(RoomListModel::NameRole);
-    } else if (sortOrder == SortFilterRoomListModel::LastActivity) {
+    } else {
         setSortRole(RoomListModel::LastActiveTimeRole);
     }
     invalidate();
@@ -35,47 +41,152 @@ SortFilterRoomListModel::RoomSortOrder SortFilterRoomListModel::roomSortOrder()
     return m_sortOrder;
 }
 
-bool SortFilterRoomListModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
+void SortFilterRoomListModel::setSourceModel(QAbstractItemModel *sourceModel)
 {
-    if (m_sortOrder == SortFilterRoomListModel::LastActivity) {
-        // display favorite rooms always on top
-        const auto categoryLeft = static_cast<RoomType::Types>(sourceModel()->data(source_left, RoomListModel::CategoryRole).toInt());
-        const auto categoryRight = static_cast<RoomType::Types>(sourceModel()->data(source_right, RoomListModel::CategoryRole).toInt());
+    if (this->sourceModel()) {
+        this->sourceModel()->disconnect(this);
+    }
+    if (m_transactionSource) {
+        m_transactionSource->disconnect(this);
+    }
+    m_sortKeys.clear();
+
+    // Connected before the base class connects its own slots, so that the
+    // sort keys are up to date when it re-sorts the changed rows.
+    if (sourceModel) {
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, &SortFilterRoomListModel::invalidateSortKeys);
+        connect(sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &, int first, int last) {
+            if (first <= m_sortKeys.size()) {
+                m_sortKeys.insert(first, last - first + 1, std::nullopt);
+            }
+        });
+        connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex &, int first, int last) {
+            if (first < m_sortKeys.size()) {
+                m_sortKeys.remove(first, qMin(last + 1, m_sortKeys.size()) - first);
+            }
+        });
+        connect(sourceModel, &QAbstractItemModel::rowsMoved, this, [this] {
+            m_sortKeys.clear();
+        });
+        connect(sourceModel, &QAbstractItemModel::layoutChanged, this, [this] {
+            m_sortKeys.clear();
+        });
+        connect(sourceModel, &QAbstractItemModel::modelReset, this, [this] {
+            m_sortKeys.clear();
+        });
 
-        if (categoryLeft == RoomType::Types::Favorite && categoryRight == RoomType::Types::Favorite) {
-            return sourceModel()->data(source_left, RoomListModel::LastActiveTimeRole).toDateTime() > sourceModel()->data(source_right, RoomListModel::LastActiveTimeRole).toDateTime();
+        QAbstractItemModel *root = sourceModel;
+        while (auto proxy = qobject_cast<QAbstractProxyModel *>(root)) {
+            root = proxy->sourceModel();
         }
-        if (categoryLeft == RoomType::Types::Favorite) {
-            return true;
-        } else if (categoryRight == RoomType::Types::Favorite) {
-            return false;
+        if (auto roomListModel = qobject_cast<RoomListModel *>(root)) {
+            connect(roomListModel, &RoomListModel::aboutToCommitTransaction, this, &SortFilterRoomListModel::suspendSorting);
+            connect(roomListModel, &RoomListModel::transactionCommitted, this, &SortFilterRoomListModel::resumeSorting);
+        } else if (auto mergedRoomListModel = qobject_cast<MergedRoomListModel *>(root)) {
+            connect(mergedRoomListModel, &MergedRoomListModel::aboutToCommitTransaction, this, &SortFilterRoomListModel::suspendSorting);
+            connect(mergedRoomListModel, &MergedRoomListModel::transactionCommitted, this, &SortFilterRoomListModel::resumeSorting);
         }
+        m_transactionSource = root;
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+void SortFilterRoomListModel::suspendSorting()
+{
+    // The changes of the transaction are only mapped, not sorted or filtered
+    setDynamicSortFilter(false);
+    m_filterChanged = false;
+}
+
+void SortFilterRoomListModel::resumeSorting()
+{
+    // Sorts the whole list once
+    setDynamicSortFilter(true);
+    if (m_filterChanged) {
+        invalidateFilter();
+    }
+}
 
-        return sourceModel()->data(source_left, RoomListModel::LastActiveTimeRole).toDateTime() > sourceModel()->data(source_right, RoomListModel::LastActiveTimeRole).toDateTime();
+void SortFilterRoomListModel::invalidateSortKeys(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    // Upgraded rooms are filtered out
+    if (!dynamicSortFilter() && (roles.isEmpty() || roles.contains(RoomListModel::JoinStateRole))) {
+        m_filterChanged = true;
+    }
+    static const QVector<int> sortRoles = {
+        RoomListModel::NameRole,
+        RoomListModel::CategoryRole,
+        RoomListModel::LastEventRole,
+        RoomListModel::LastActiveTimeRole,
+    };
+    if (!roles.isEmpty() && std::none_of(roles.begin(), roles.end(), [](int role) {
+            return sortRoles.contains(role);
+        })) {
+        return;
     }
-    if (m_sortOrder != SortFilterRoomListModel::Categories) {
-        return QSortFilterProxyModel::lessThan(source_left, source_right);
+    for (int row = topLeft.row(); row <= bottomRight.row() && row < m_sortKeys.size(); ++row) {
+        m_sortKeys[row].reset();
     }
-    if (sourceModel()->data(source_left, RoomListModel::CategoryRole) != sourceModel()->data(source_right, RoomListModel::CategoryRole)) {
-        return sourceModel()->data(source_left, RoomListModel::CategoryRole).toInt() < sourceModel()->data(source_right, RoomListModel::CategoryRole).toInt();
+
+    // The base class only moves rows when the sort role changed, but the
+    // category is part of the order too. Within a transaction, the whole list
+    // is sorted when it is committed anyway.
+    if (dynamicSortFilter() && m_sortOrder != Alphabetical && roles.contains(RoomListModel::CategoryRole) && !roles.contains(sortRole())) {
+        invalidate();
+    }
+}
+
+void SortFilterRoomListModel::reserveSortKeys() const
+{
+    // Growing the cache reallocates it, which must not happen while a
+    // reference to one of its keys is held
+    const int rowCount = sourceModel()->rowCount();
+    if (m_sortKeys.size() < rowCount) {
+        m_sortKeys.resize(rowCount);
     }
-    return sourceModel()->data(source_left, RoomListModel::LastActiveTimeRole).toDateTime() > sourceModel()->data(source_right, RoomListModel::LastActiveTimeRole).toDateTime();
 }
 
-void SortFilterRoomListModel::setFilterText(const QString &text)
+const SortFilterRoomListModel::SortKey &SortFilterRoomListModel::sortKey(const QModelIndex &sourceIndex) const
 {
-    m_filterText = text;
-    Q_EMIT filterTextChanged();
+    auto &key = m_sortKeys[sourceIndex.row()];
+    if (!key) {
+        key = SortKey();
+        key->category = sourceModel()->data(sourceIndex, RoomListModel::CategoryRole).toInt();
+        key->favourite = key->category == RoomType::Favorite;
+        key->lastActive = sourceModel()->data(sourceIndex, RoomListModel::LastActiveTimeRole).toDateTime().toMSecsSinceEpoch();
+        key->name = m_collator.sortKey(sourceModel()->data(sourceIndex, RoomListModel::NameRole).toString());
+    }
+    return *key;
 }
 
-QString SortFilterRoomListModel::filterText() const
+bool SortFilterRoomListModel::lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const
 {
-    return m_filterText;
+    reserveSortKeys();
+    const auto &left = sortKey(source_left);
+    const auto &right = sortKey(source_right);
+
+    switch (m_sortOrder) {
+    case SortFilterRoomListModel::Alphabetical:
+        return left.name->compare(*right.name) < 0;
+    case SortFilterRoomListModel::LastActivity:
+        // display favorite rooms always on top
+        if (left.favourite != right.favourite) {
+            return left.favourite;
+        }
+        return left.lastActive > right.lastActive;
+    case SortFilterRoomListModel::Categories:
+        if (left.category != right.category) {
+            return left.category < right.category;
+        }
+        return left.lastActive > right.lastActive;
+    }
+    return false;
 }
 
 bool SortFilterRoomListModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
 {
     Q_UNUSED(source_parent);
-    return sourceModel()->data(sourceModel()->index(source_row, 0), RoomListModel::NameRole).toString().contains(m_filterText, Qt::CaseInsensitive) &&
-        sourceModel()->data(sourceModel()->index(source_row, 0), RoomListModel::JoinStateRole).toString() != "upgraded";
+    // Upgraded rooms are replaced by their successor; placeholder rows have no room yet
+    const auto room = sourceModel()->data(sourceModel()->index(source_row, 0), RoomListModel::CurrentRoomRole).value<NeoChatRoom *>();
+    return !room || room->successorId().isEmpty();
 }
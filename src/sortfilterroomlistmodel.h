@@ -6,14 +6,17 @@
 
 #pragma once
 
+#include <QCollator>
+#include <QPointer>
 #include <QSortFilterProxyModel>
 
+#include <optional>
+
 class SortFilterRoomListModel : public QSortFilterProxyModel
 {
     Q_OBJECT
 
     Q_PROPERTY(RoomSortOrder roomSortOrder READ roomSortOrder WRITE setRoomSortOrder NOTIFY roomSortOrderChanged)
-    Q_PROPERTY(QString filterText READ filterText READ filterText WRITE setFilterText NOTIFY filterTextChanged)
 
 public:
     enum RoomSortOrder {
@@ -28,19 +31,40 @@ public:
     void setRoomSortOrder(RoomSortOrder sortOrder);
     [[nodiscard]] RoomSortOrder roomSortOrder() const;
 
-    void setFilterText(const QString &text);
-    [[nodiscard]] QString filterText() const;
-
     [[nodiscard]] bool lessThan(const QModelIndex &source_left, const QModelIndex &source_right) const override;
 
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+
 protected:
     [[nodiscard]] bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const override;
 
 Q_SIGNALS:
     void roomSortOrderChanged();
-    void filterTextChanged();
 
 private:
     RoomSortOrder m_sortOrder = Categories;
-    QString m_filterText;
+
+    /// What lessThan() compares, read from the source model once per change
+    /// of the row instead of once per comparison.
+    struct SortKey {
+        int category = 0;
+        bool favourite = false;
+        qint64 lastActive = 0;
+        std::optional<QCollatorSortKey> name;
+    };
+    QCollator m_collator;
+    /// Indexed by source row; rows without a value are read on demand
+    mutable QVector<std::optional<SortKey>> m_sortKeys;
+
+    /// Make room for the keys of all source rows; to be called before sortKey()
+    void reserveSortKeys() const;
+    [[nodiscard]] const SortKey &sortKey(const QModelIndex &sourceIndex) const;
+    void invalidateSortKeys(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+
+    /// The room list at the bottom of the source proxies, whose transactions
+    /// are sorted once instead of once per changed row
+    QPointer<QObject> m_transactionSource;
+    bool m_filterChanged = false;
+    void suspendSorting();
+    void resumeSorting();
 };
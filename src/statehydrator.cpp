@@ -0,0 +1,222 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "statehydrator.h"
+
+#include <QCborValue>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QTimer>
+
+#include "connection.h"
+#include "neochatconfig.h"
+#include "syncdata.h"
+
+using namespace Quotient;
+
+static const int FirstBatchSize = 30;
+static const int BatchSize = 20;
+
+static QJsonObject loadJson(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    const auto data = file.readAll();
+    // Same detection as libQuotient: the cache is either JSON or CBOR
+    return data.startsWith('{') ? QJsonDocument::fromJson(data).object() : QCborValue::fromCbor(data).toJsonValue().toObject();
+}
+
+StateHydrator::StateHydrator(Connection *connection)
+    : QObject(connection)
+    , m_connection(connection)
+{
+}
+
+bool StateHydrator::start()
+{
+    m_timer.start();
+    if (!m_connection->cacheState()) {
+        return false;
+    }
+
+    const auto cacheDir = m_connection->stateCacheDir();
+
+    m_index.load(RoomSummaryIndex::fileName(m_connection->userId()));
+    m_indexLoadTime = m_timer.elapsed();
+
+    m_topLevel = loadJson(cacheDir.filePath(QStringLiteral("state.json")));
+    const auto cacheVersion = m_topLevel[QLatin1String("cache_version")].toObject()[QLatin1String("major")].toInt();
+    if (m_topLevel[QLatin1String("next_batch")].toString().isEmpty() || cacheVersion != SyncData::cacheVersion().first) {
+        return false;
+    }
+
+    const auto sections = m_topLevel[QLatin1String("rooms")].toObject();
+    for (auto section = sections.constBegin(); section != sections.constEnd(); ++section) {
+        const auto rooms = section.value().toObject();
+        for (auto room = rooms.constBegin(); room != rooms.constEnd(); ++room) {
+            // libQuotient drops the whole cache if a room file is missing; do the same
+            // before anything has been loaded rather than ending up with a partial state.
+            if (!QFileInfo::exists(cacheDir.filePath(SyncData::fileNameForRoom(room.key())))) {
+                qWarning() << "State cache incomplete, room" << room.key() << "is missing";
+                return false;
+            }
+            m_roomSections.insert(room.key(), section.key());
+            m_queue += room.key();
+        }
+    }
+    m_totalRooms = m_queue.size();
+    m_topLevelLoadTime = m_timer.elapsed() - m_indexLoadTime;
+
+    sortQueue();
+    hydrateBatch(m_queue.mid(0, FirstBatchSize));
+    m_queue = m_queue.mid(FirstBatchSize);
+    m_firstBatchTime = m_timer.elapsed() - m_topLevelLoadTime - m_indexLoadTime;
+
+    scheduleNextBatch();
+    return true;
+}
+
+void StateHydrator::sortQueue()
+{
+    const auto openRoom = NeoChatConfig::self()->openRoom();
+
+    // Lower is loaded earlier
+    auto rank = [this, &openRoom](const QString &roomId) {
+        if (roomId == openRoom) {
+            return 0;
+        }
+        if (m_roomSections.value(roomId) == QLatin1String("invite")) {
+            return 1;
+        }
+        const auto summary = m_index.summary(roomId);
+        if (summary.highlightCount > 0) {
+            return 2;
+        }
+        if (summary.notificationCount > 0) {
+            return 3;
+        }
+        return m_index.contains(roomId) ? 4 : 5;
+    };
+
+    std::stable_sort(m_queue.begin(), m_queue.end(), [this, &rank](const QString &left, const QString &right) {
+        const auto leftRank = rank(left);
+        const auto rightRank = rank(right);
+        if (leftRank != rightRank) {
+            return leftRank < rightRank;
+        }
+        return m_index.summary(left).lastActiveTime > m_index.summary(right).lastActiveTime;
+    });
+}
+
+void StateHydrator::hydrate(const QString &roomId)
+{
+    if (!m_queue.removeOne(roomId)) {
+        return;
+    }
+    hydrateBatch({roomId});
+}
+
+QVector<RoomSummary> StateHydrator::pendingSummaries() const
+{
+    QVector<RoomSummary> summaries;
+    summaries.reserve(m_queue.size());
+    for (const auto &roomId : m_queue) {
+        if (m_index.contains(roomId)) {
+            summaries += m_index.summary(roomId);
+        }
+    }
+    return summaries;
+}
+
+void StateHydrator::hydrateBatch(const QStringList &roomIds)
+{
+    if (roomIds.isEmpty()) {
+        return;
+    }
+
+    QJsonObject rooms;
+    for (const auto &roomId : roomIds) {
+        const auto section = m_roomSections.value(roomId);
+        auto sectionRooms = rooms[section].toObject();
+        sectionRooms.insert(roomId, QJsonValue::Null);
+        rooms.insert(section, sectionRooms);
+    }
+
+    // Every batch carries the sync token since applying a batch overwrites it,
+    // the first one also carries account data and everything else not room-specific.
+    QJsonObject json;
+    if (m_firstBatch) {
+        json = m_topLevel;
+        m_firstBatch = false;
+    }
+    json.insert(QStringLiteral("next_batch"), m_topLevel[QLatin1String("next_batch")]);
+    json.insert(QStringLiteral("rooms"), rooms);
+
+    SyncData data;
+    data.parseJson(json, m_connection->stateCacheDir().path() + QLatin1Char('/'));
+    m_connection->onSyncSuccess(std::move(data), true);
+
+    m_hydratedRooms += roomIds.size();
+    Q_EMIT progress();
+}
+
+void StateHydrator::scheduleNextBatch()
+{
+    if (m_queue.isEmpty()) {
+        m_totalTime = m_timer.elapsed();
+        m_finished = true;
+        m_topLevel = {};
+        qDebug() << "Loaded the state of" << m_hydratedRooms << "rooms for" << m_connection->userId() << "in" << m_totalTime << "ms (index" << m_indexLoadTime
+                 << "ms, top-level state" << m_topLevelLoadTime << "ms, first batch" << m_firstBatchTime << "ms)";
+        Q_EMIT finished();
+        return;
+    }
+
+    QTimer::singleShot(0, this, [this] {
+        hydrateBatch(m_queue.mid(0, BatchSize));
+        m_queue = m_queue.mid(BatchSize);
+        scheduleNextBatch();
+    });
+}
+
+int StateHydrator::hydratedRooms() const
+{
+    return m_hydratedRooms;
+}
+
+int StateHydrator::totalRooms() const
+{
+    return m_totalRooms;
+}
+
+bool StateHydrator::isFinished() const
+{
+    return m_finished;
+}
+
+qint64 StateHydrator::indexLoadTime() const
+{
+    return m_indexLoadTime;
+}
+
+qint64 StateHydrator::topLevelLoadTime() const
+{
+    return m_topLevelLoadTime;
+}
+
+qint64 StateHydrator::firstBatchTime() const
+{
+    return m_firstBatchTime;
+}
+
+qint64 StateHydrator::totalTime() const
+{
+    return m_totalTime;
+}
@@ -0,0 +1,87 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+#include "roomsummaryindex.h"
+
+namespace Quotient
+{
+class Connection;
+}
+
+/// Loads the cached state of a connection in prioritized batches.
+///
+/// Connection::loadState() parses the cache of every room before returning.
+/// Instead, the top-level state is read first and the rooms are ordered using
+/// the room summary index: the last opened room, invitations, rooms with
+/// unread highlights and notifications, then by last activity. The first batch
+/// is loaded synchronously in start() so that the room list can be shown right
+/// away, the rest is loaded in small batches from the event loop. Until then
+/// RoomListModel shows the rooms still waiting from their summaries, and a room
+/// that is opened is loaded out of order with hydrate().
+class StateHydrator : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int hydratedRooms READ hydratedRooms NOTIFY progress)
+    Q_PROPERTY(int totalRooms READ totalRooms CONSTANT)
+    Q_PROPERTY(bool finished READ isFinished NOTIFY finished)
+
+public:
+    explicit StateHydrator(Quotient::Connection *connection);
+
+    /// Read the top-level state and load the first batch of rooms.
+    ///
+    /// \return false if there is no usable cache; the caller should then fall back
+    /// to Connection::loadState().
+    bool start();
+
+    /// Load the cached state of the room now if it hasn't been loaded yet.
+    void hydrate(const QString &roomId);
+
+    /// Summaries of the rooms that aren't loaded yet, as far as the index knows them.
+    [[nodiscard]] QVector<RoomSummary> pendingSummaries() const;
+
+    [[nodiscard]] int hydratedRooms() const;
+    [[nodiscard]] int totalRooms() const;
+    [[nodiscard]] bool isFinished() const;
+
+    /// Time spent in each phase, in milliseconds.
+    [[nodiscard]] qint64 indexLoadTime() const;
+    [[nodiscard]] qint64 topLevelLoadTime() const;
+    [[nodiscard]] qint64 firstBatchTime() const;
+    [[nodiscard]] qint64 totalTime() const;
+
+Q_SIGNALS:
+    void progress();
+    void finished();
+
+private:
+    Quotient::Connection *m_connection;
+    RoomSummaryIndex m_index;
+    QJsonObject m_topLevel;
+    QStringList m_queue;
+    QHash<QString, QString> m_roomSections;
+    int m_totalRooms = 0;
+    int m_hydratedRooms = 0;
+    bool m_finished = false;
+    bool m_firstBatch = true;
+
+    QElapsedTimer m_timer;
+    qint64 m_indexLoadTime = 0;
+    qint64 m_topLevelLoadTime = 0;
+    qint64 m_firstBatchTime = 0;
+    qint64 m_totalTime = 0;
+
+    void sortQueue();
+    void hydrateBatch(const QStringList &roomIds);
+    void scheduleNextBatch();
+};
@@ -0,0 +1,222 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "statepersister.h"
+
+#include <QCborValue>
+#include <QDebug>
+#include <QDir>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+#include "connection.h"
+#include "neochatroom.h"
+#include "settings.h"
+#include "syncdata.h"
+
+using namespace Quotient;
+
+// The top-level state only carries the sync token and the account data, both of
+// which are replayed by the server if they are slightly out of date on startup.
+static const qint64 TopLevelSaveInterval = 5 * 60 * 1000;
+
+StatePersister::StatePersister(Connection *connection)
+    : QObject(connection)
+    , m_connection(connection)
+    , m_cacheState(connection->cacheState())
+    , m_cacheToBinary(SettingsGroup("libQuotient").value("cache_type").toString() != QLatin1String("json"))
+{
+    // Room::updateData() writes every changed room synchronously through
+    // Connection::saveRoomState() unless caching is disabled on the connection.
+    // The persister takes over writing the cache, so switch that off and only
+    // enable it around the writes of the top-level state.
+    m_connection->setCacheState(false);
+
+    // A single writer thread keeps the writes of a room in order.
+    m_ioPool.setMaxThreadCount(1);
+    m_ioPool.setExpiryTimeout(-1);
+
+    const bool hasSummaries = m_summaries.load(RoomSummaryIndex::fileName(m_connection->userId()));
+    const auto rooms = m_connection->allRooms();
+    for (auto room : rooms) {
+        connectRoom(room);
+        if (!hasSummaries) {
+            m_staleSummaries.insert(room->id());
+        }
+    }
+    connect(m_connection, &Connection::newRoom, this, [this](Room *room) {
+        connectRoom(room);
+        markDirty(room);
+    });
+    connect(m_connection, &Connection::aboutToDeleteRoom, this, [this](Room *room) {
+        m_dirtyRooms.remove(room->id());
+        m_staleSummaries.remove(room->id());
+        m_summaries.remove(room->id());
+        m_summariesChanged = true;
+    });
+    // The category of the room is part of its summary but not of its state
+    connect(m_connection, &Connection::directChatsListChanged, this, [this](const DirectChatsMap &additions, const DirectChatsMap &removals) {
+        for (const auto &roomId : additions) {
+            m_staleSummaries.insert(roomId);
+        }
+        for (const auto &roomId : removals) {
+            m_staleSummaries.insert(roomId);
+        }
+    });
+}
+
+StatePersister::~StatePersister()
+{
+    m_ioPool.waitForDone();
+}
+
+void StatePersister::connectRoom(Room *room)
+{
+    connect(room, &Room::changed, this, [this, room] {
+        markDirty(room);
+    });
+    connect(room, &Room::notificationCountChanged, this, [this, room] {
+        markDirty(room);
+    });
+    connect(room, &Room::highlightCountChanged, this, [this, room] {
+        markDirty(room);
+    });
+    connect(room, &Room::readMarkerMoved, this, [this, room] {
+        markDirty(room);
+    });
+    connect(room, &Room::tagsChanged, this, [this, room] {
+        markDirty(room);
+    });
+    // New messages change the last event of the summary, not the cached state
+    connect(room, &Room::addedMessages, this, [this, room] {
+        m_staleSummaries.insert(room->id());
+    });
+}
+
+void StatePersister::markDirty(Room *room)
+{
+    ++m_roomChanges;
+    m_dirtyRooms.insert(room->id());
+}
+
+bool StatePersister::isDirty(const QString &roomId) const
+{
+    return m_dirtyRooms.contains(roomId);
+}
+
+void StatePersister::flush()
+{
+    const auto dirtyRooms = std::exchange(m_dirtyRooms, {});
+
+    // The room list shows the summaries on the next start even without a state cache
+    auto staleSummaries = std::exchange(m_staleSummaries, {});
+    staleSummaries += dirtyRooms;
+    for (const auto &roomId : qAsConst(staleSummaries)) {
+        if (auto room = m_connection->room(roomId)) {
+            m_summaries.update(static_cast<NeoChatRoom *>(room));
+            m_summariesChanged = true;
+        }
+    }
+    if (m_summariesChanged) {
+        m_summariesChanged = false;
+        m_ioPool.start([summaries = m_summaries, fileName = RoomSummaryIndex::fileName(m_connection->userId())] {
+            if (!summaries.save(fileName)) {
+                qWarning() << "Unable to write room summary index" << fileName;
+            }
+        });
+    }
+
+    if (!m_cacheState) {
+        return;
+    }
+
+    if (!m_topLevelSaved.isValid() || m_topLevelSaved.hasExpired(TopLevelSaveInterval)) {
+        saveTopLevelState();
+    }
+
+    for (const auto &roomId : dirtyRooms) {
+        if (auto room = m_connection->room(roomId)) {
+            writeRoom(room);
+        }
+    }
+
+    ++m_flushCount;
+    m_roomsSkipped += m_connection->allRooms().size() - dirtyRooms.size();
+    Q_EMIT statisticsChanged();
+}
+
+void StatePersister::flushAndWait()
+{
+    if (m_cacheState) {
+        saveTopLevelState();
+    }
+    flush();
+    m_ioPool.waitForDone();
+}
+
+void StatePersister::saveTopLevelState()
+{
+    m_connection->setCacheState(true);
+    m_connection->saveState();
+    m_connection->setCacheState(false);
+    m_topLevelSaved.start();
+}
+
+void StatePersister::writeRoom(Room *room)
+{
+    // Taking the snapshot has to happen on the thread owning the room,
+    // everything after that is independent from it.
+    const auto json = room->toJson();
+    const auto fileName = m_connection->stateCacheDir().filePath(SyncData::fileNameForRoom(room->id()));
+    const bool toBinary = m_cacheToBinary;
+
+    m_ioPool.start([this, json, fileName, toBinary] {
+        const auto data = toBinary ? QCborValue::fromJsonValue(json).toCbor() : QJsonDocument(json).toJson(QJsonDocument::Compact);
+
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+            qWarning() << "Unable to write room state cache" << fileName << file.errorString();
+            return;
+        }
+
+        const qint64 written = data.size();
+        QMetaObject::invokeMethod(
+            this,
+            [this, written] {
+                ++m_roomsWritten;
+                m_bytesWritten += written;
+                Q_EMIT statisticsChanged();
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+int StatePersister::flushCount() const
+{
+    return m_flushCount;
+}
+
+int StatePersister::roomsWritten() const
+{
+    return m_roomsWritten;
+}
+
+int StatePersister::roomsSkipped() const
+{
+    return m_roomsSkipped;
+}
+
+qint64 StatePersister::bytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+qreal StatePersister::writeAmplification() const
+{
+    if (m_roomChanges == 0) {
+        return 0;
+    }
+    return qreal(m_roomsWritten) / m_roomChanges;
+}
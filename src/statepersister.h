@@ -0,0 +1,94 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+#include "roomsummaryindex.h"
+
+namespace Quotient
+{
+class Connection;
+class Room;
+}
+
+/// Incremental persistence of the state cache of a connection.
+///
+/// Rooms are marked dirty when they change and only those are written when
+/// flush() is called, typically once per sync. The JSON snapshot of a room is
+/// taken on the GUI thread, encoding and the atomic file replacement happen on
+/// a dedicated I/O thread. The top-level state (sync token, account data) is
+/// rewritten at most every few minutes and when flushing on shutdown.
+///
+/// While the persister exists, the state caching of libQuotient itself is
+/// disabled on the connection so that rooms aren't written twice.
+///
+/// The room summary index is kept up to date along with the dirty rooms and
+/// the rooms that got new messages, and written even when the state cache is
+/// disabled, since the room list shows it on the next start.
+class StatePersister : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int flushCount READ flushCount NOTIFY statisticsChanged)
+    Q_PROPERTY(int roomsWritten READ roomsWritten NOTIFY statisticsChanged)
+    Q_PROPERTY(int roomsSkipped READ roomsSkipped NOTIFY statisticsChanged)
+    Q_PROPERTY(qint64 bytesWritten READ bytesWritten NOTIFY statisticsChanged)
+    Q_PROPERTY(qreal writeAmplification READ writeAmplification NOTIFY statisticsChanged)
+
+public:
+    explicit StatePersister(Quotient::Connection *connection);
+    ~StatePersister() override;
+
+    /// Write all rooms that changed since the last flush.
+    void flush();
+
+    /// Write all dirty rooms and the top-level state, then block until
+    /// everything reached the disk. Meant to be used on shutdown.
+    void flushAndWait();
+
+    [[nodiscard]] bool isDirty(const QString &roomId) const;
+
+    /// Number of flushes done so far.
+    [[nodiscard]] int flushCount() const;
+    /// Number of room files written so far.
+    [[nodiscard]] int roomsWritten() const;
+    /// Number of room files a full state save would have written on top of roomsWritten().
+    [[nodiscard]] int roomsSkipped() const;
+    /// Number of bytes written to the room state cache so far.
+    [[nodiscard]] qint64 bytesWritten() const;
+    /// Ratio of room files written to room changes observed, 1.0 meaning
+    /// that each change caused exactly one write.
+    [[nodiscard]] qreal writeAmplification() const;
+
+Q_SIGNALS:
+    void statisticsChanged();
+
+private:
+    Quotient::Connection *m_connection;
+    QSet<QString> m_dirtyRooms;
+    RoomSummaryIndex m_summaries;
+    /// Rooms whose summary changed without their state changing
+    QSet<QString> m_staleSummaries;
+    bool m_summariesChanged = false;
+    QThreadPool m_ioPool;
+    QElapsedTimer m_topLevelSaved;
+    bool m_cacheState;
+    bool m_cacheToBinary;
+
+    int m_flushCount = 0;
+    int m_roomsWritten = 0;
+    int m_roomsSkipped = 0;
+    int m_roomChanges = 0;
+    qint64 m_bytesWritten = 0;
+
+    void connectRoom(Quotient::Room *room);
+    void markDirty(Quotient::Room *room);
+    void saveTopLevelState();
+    void writeRoom(Quotient::Room *room);
+};
@@ -0,0 +1,144 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "syncfilter.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include "connection.h"
+#include "csapi/filter.h"
+#include "neochatconfig.h"
+#include "settings.h"
+
+using namespace Quotient;
+
+/// Non-state events that are neither shown nor applied to other events
+static const QJsonArray TimelineUnusedTypes {
+    QStringLiteral("m.call.*"),
+    QStringLiteral("org.matrix.call.*"),
+    QStringLiteral("m.key.verification.*"),
+    QStringLiteral("org.matrix.msc3381.poll.*"),
+};
+
+/// Account data of other clients and of end-to-end encryption, which this build doesn't support
+static const QJsonArray AccountDataUnusedTypes {
+    QStringLiteral("m.push_rules"),
+    QStringLiteral("m.secret_storage.*"),
+    QStringLiteral("m.cross_signing.*"),
+    QStringLiteral("m.megolm_backup.*"),
+    QStringLiteral("im.vector.*"),
+    QStringLiteral("io.element.*"),
+};
+
+/// Room account data of other clients; tags and the read marker are kept
+static const QJsonArray RoomAccountDataUnusedTypes {
+    QStringLiteral("im.vector.*"),
+    QStringLiteral("io.element.*"),
+    QStringLiteral("org.matrix.*"),
+};
+
+/// Delay before retrying a failed upload, doubled with each failure
+static const qint64 RetryDelay = 60 * 1000;
+static const qint64 MaxRetryDelay = 60 * 60 * 1000;
+
+SyncFilter::SyncFilter(Connection *connection)
+    : QObject(connection)
+    , m_connection(connection)
+{
+    AccountSettings account(m_connection->userId());
+    m_definition = QJsonDocument::fromJson(account.value(QStringLiteral("neochat_sync_filter")).toByteArray()).object();
+    m_filterId = account.value(QStringLiteral("neochat_sync_filter_id")).toString();
+}
+
+QJsonObject SyncFilter::definition(int timelineLimit, bool lazyLoadMembers, bool showLeaveJoinEvents)
+{
+    // Besides messages, MessageEventModel shows all kinds of state events, and
+    // libQuotient applies reactions and redactions to the events they refer to.
+    // Other events end up as "other" and are never shown.
+    QJsonArray timelineNotTypes = TimelineUnusedTypes;
+    if (!showLeaveJoinEvents && lazyLoadMembers) {
+        // The members of the senders still arrive with the lazy-loaded state;
+        // this also hides invitations, kicks and profile changes of others
+        timelineNotTypes.append(QStringLiteral("m.room.member"));
+    }
+    QJsonObject timeline {
+        {QStringLiteral("limit"), timelineLimit},
+        {QStringLiteral("not_types"), timelineNotTypes},
+    };
+    QJsonObject state;
+    if (lazyLoadMembers) {
+        timeline.insert(QStringLiteral("lazy_load_members"), true);
+        state.insert(QStringLiteral("lazy_load_members"), true);
+    }
+
+    return QJsonObject {
+        // Presence isn't shown anywhere
+        {QStringLiteral("presence"), QJsonObject {{QStringLiteral("not_types"), QJsonArray {QStringLiteral("*")}}}},
+        {QStringLiteral("account_data"), QJsonObject {{QStringLiteral("not_types"), AccountDataUnusedTypes}}},
+        {QStringLiteral("room"),
+         QJsonObject {
+             {QStringLiteral("timeline"), timeline},
+             {QStringLiteral("state"), state},
+             // Only typing notifications and read receipts are shown
+             {QStringLiteral("ephemeral"), QJsonObject {{QStringLiteral("types"), QJsonArray {QStringLiteral("m.typing"), QStringLiteral("m.receipt")}}}},
+             {QStringLiteral("account_data"), QJsonObject {{QStringLiteral("not_types"), RoomAccountDataUnusedTypes}}},
+         }},
+    };
+}
+
+QString SyncFilter::filterParameter()
+{
+    const auto definition = SyncFilter::definition(NeoChatConfig::self()->syncTimelineLimit(), m_connection->lazyLoading(), NeoChatConfig::self()->showLeaveJoinEvent());
+    if (definition != m_definition) {
+        m_definition = definition;
+        m_filterId.clear();
+        m_failures = 0;
+    }
+
+    if (!m_filterId.isEmpty()) {
+        return m_filterId;
+    }
+    if (mayUpload()) {
+        upload();
+    }
+    return QString::fromUtf8(QJsonDocument(m_definition).toJson(QJsonDocument::Compact));
+}
+
+bool SyncFilter::mayUpload() const
+{
+    // An upload for outdated settings is left to finish; the next sync after it uploads the current definition
+    if (m_job) {
+        return false;
+    }
+    if (m_failures == 0) {
+        return true;
+    }
+    const auto delay = qMin(MaxRetryDelay, RetryDelay << qMin(m_failures - 1, 10));
+    return m_lastFailure.hasExpired(delay);
+}
+
+void SyncFilter::upload()
+{
+    m_job = m_connection->callApi<DefineFilterJob>(BackgroundRequest, m_connection->userId(), fromJson<Filter>(QJsonValue(m_definition)));
+    connect(m_job, &BaseJob::success, this, [this, job = m_job.data(), definition = m_definition] {
+        m_failures = 0;
+        if (definition != m_definition) {
+            return; // The settings changed in the meantime
+        }
+        m_filterId = job->filterId();
+
+        AccountSettings account(m_connection->userId());
+        account.setValue(QStringLiteral("neochat_sync_filter"), QJsonDocument(definition).toJson(QJsonDocument::Compact));
+        account.setValue(QStringLiteral("neochat_sync_filter_id"), m_filterId);
+        account.sync();
+    });
+    connect(m_job, &BaseJob::failure, this, [this, job = m_job.data()] {
+        qWarning() << "Could not upload the sync filter:" << job->errorString();
+        ++m_failures;
+        m_lastFailure.start();
+    });
+}
@@ -0,0 +1,59 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QObject>
+#include <QPointer>
+
+namespace Quotient
+{
+class Connection;
+class DefineFilterJob;
+}
+
+/// Server-side filter used for the syncs of a connection.
+///
+/// The filter definition is derived from the settings, so that the server
+/// doesn't send what no part of NeoChat uses, such as presence, timeline
+/// events that are never shown and account data of other clients, and limits
+/// the timeline events per room and sync. It is uploaded once and
+/// then referred to by its id; the id is kept in the account settings
+/// together with the definition it was created for. When the settings
+/// change, a new filter is uploaded and the definition is sent inline until
+/// the server has returned the new id. Only one upload runs at a time, and
+/// failed uploads are retried with an exponential back-off.
+class SyncFilter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncFilter(Quotient::Connection *connection);
+
+    /// Build the filter definition.
+    ///
+    /// \param timelineLimit the maximum number of timeline events per room and sync
+    /// \param lazyLoadMembers whether member events are lazy-loaded, as set on the connection
+    /// \param showLeaveJoinEvents whether membership events are shown in the timeline
+    [[nodiscard]] static QJsonObject definition(int timelineLimit, bool lazyLoadMembers, bool showLeaveJoinEvents);
+
+    /// The value of the filter parameter of the next sync: the filter id if
+    /// the current definition has been uploaded, the definition itself otherwise.
+    [[nodiscard]] QString filterParameter();
+
+private:
+    Quotient::Connection *m_connection;
+    QJsonObject m_definition;
+    QString m_filterId;
+    QPointer<Quotient::DefineFilterJob> m_job;
+    /// Uploads that failed in a row, and when the last one did
+    int m_failures = 0;
+    QElapsedTimer m_lastFailure;
+
+    void upload();
+    [[nodiscard]] bool mayUpload() const;
+};
@@ -0,0 +1,354 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "syncscheduler.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QGuiApplication>
+#include <QRandomGenerator>
+#include <QWindow>
+
+#include <algorithm>
+
+#include "connection.h"
+#include "neochatconfig.h"
+#include "syncfilter.h"
+#include "syncthread.h"
+
+using namespace Quotient;
+
+static const int LongPollTimeout = 30 * 1000;
+static const int BackgroundInterval = 60 * 1000;
+static const int IdleInterval = 5 * 60 * 1000;
+static const qint64 IdleThreshold = 15 * 60 * 1000;
+static const int MinRetryInterval = 1000;
+static const int MaxRetryInterval = 5 * 60 * 1000;
+
+// An unfocused window is still in the foreground: it shows new messages as
+// they arrive. Only a window hidden to the tray or minimized is not.
+static bool isWindowShown()
+{
+    const auto state = QGuiApplication::applicationState();
+    if (state == Qt::ApplicationHidden || state == Qt::ApplicationSuspended) {
+        return false;
+    }
+    const auto windows = QGuiApplication::topLevelWindows();
+    if (windows.isEmpty()) {
+        return true;
+    }
+    return std::any_of(windows.cbegin(), windows.cend(), [](QWindow *window) {
+        return window->isVisible() && window->visibility() != QWindow::Minimized;
+    });
+}
+
+SyncScheduler::SyncScheduler(Connection *connection)
+    : QObject(connection)
+    , m_connection(connection)
+    , m_filter(new SyncFilter(connection))
+{
+    if (NeoChatConfig::self()->threadedSync()) {
+        createThread();
+    }
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &SyncScheduler::sync);
+
+    if (!isWindowShown()) {
+        m_hiddenSince.start();
+    }
+    trackWindows();
+    // A window shown later, like the main window once QML is loaded or after
+    // it was recreated from the tray, gets the focus or activates the application
+    connect(qGuiApp, &QGuiApplication::focusWindowChanged, this, [this] {
+        trackWindows();
+        onVisibilityChanged();
+    });
+    connect(qGuiApp, &QGuiApplication::applicationStateChanged, this, [this](Qt::ApplicationState state) {
+        trackWindows();
+        onVisibilityChanged();
+        // Catch up right away when the window is activated
+        if (state == Qt::ApplicationActive) {
+            wake();
+        }
+    });
+    updateState();
+}
+
+void SyncScheduler::trackWindows()
+{
+    const auto windows = QGuiApplication::topLevelWindows();
+    for (auto window : windows) {
+        connect(window, &QWindow::visibilityChanged, this, &SyncScheduler::onVisibilityChanged, Qt::UniqueConnection);
+    }
+}
+
+void SyncScheduler::onVisibilityChanged()
+{
+    const bool shown = isWindowShown();
+    if (shown && m_hiddenSince.isValid()) {
+        m_hiddenSince.invalidate();
+        updateState();
+        wake();
+    } else if (!shown && !m_hiddenSince.isValid()) {
+        m_hiddenSince.start();
+        updateState();
+    }
+}
+
+void SyncScheduler::start()
+{
+    m_running = true;
+    wake();
+}
+
+void SyncScheduler::stop()
+{
+    m_running = false;
+    m_timer.stop();
+    if (m_job) {
+        m_job->abandon();
+    }
+    if (m_thread) {
+        m_thread->abandon();
+    }
+}
+
+void SyncScheduler::wake()
+{
+    if (!m_running || isSyncing()) {
+        return;
+    }
+    m_timer.stop();
+    sync();
+}
+
+void SyncScheduler::sync()
+{
+    if (!m_running || isSyncing()) {
+        return;
+    }
+    updateState();
+
+    if (m_connection->nextBatchToken().isEmpty()) {
+        if (!m_thread) {
+            createThread();
+        }
+        if (!m_streaming) {
+            m_streaming = true;
+            m_streamingTimer.start();
+        }
+        m_thread->sync({}, m_filter->filterParameter(), longPollTimeout(), NeoChatConfig::self()->openRoom());
+        return;
+    }
+    if (m_thread) {
+        m_thread->sync(m_connection->nextBatchToken(), m_filter->filterParameter(), longPollTimeout());
+        return;
+    }
+
+    m_job = m_connection->callApi<SyncJob>(BackgroundRequest, m_connection->nextBatchToken(), m_filter->filterParameter(), longPollTimeout());
+    auto job = m_job.data();
+    connect(job, &BaseJob::retryScheduled, this, [this, job](int retriesTaken, int nextInMilliseconds) {
+        Q_EMIT m_connection->networkError(job->errorString(), job->rawDataSample(), retriesTaken, nextInMilliseconds);
+    });
+    connect(job, &BaseJob::success, this, [this, job] {
+        m_job = nullptr;
+        QElapsedTimer processing;
+        processing.start();
+        Q_EMIT syncAboutToBeApplied();
+        m_connection->onSyncSuccess(job->takeData());
+        Q_EMIT syncApplied();
+        onSyncSucceeded(job->rawData().size(), processing.elapsed());
+    });
+    connect(job, &BaseJob::failure, this, [this, job] {
+        m_job = nullptr;
+        onSyncFailed(BaseJob::StatusCode(job->error()), job->errorString(), job->rawDataSample());
+    });
+}
+
+void SyncScheduler::createThread()
+{
+    m_thread = new SyncThread(m_connection, this);
+    connect(m_thread, &SyncThread::succeeded, this, &SyncScheduler::onSyncSucceeded);
+    connect(m_thread, &SyncThread::failed, this, &SyncScheduler::onSyncFailed);
+    connect(m_thread, &SyncThread::progress, this, &SyncScheduler::onThreadProgress);
+    connect(m_thread, &SyncThread::chunkAboutToBeApplied, this, &SyncScheduler::syncAboutToBeApplied);
+    connect(m_thread, &SyncThread::chunkApplied, this, &SyncScheduler::syncApplied);
+}
+
+void SyncScheduler::onThreadProgress()
+{
+    if (!m_streaming) {
+        return;
+    }
+    if (m_timeToFirstRooms < 0 && m_thread->appliedRooms() > 0) {
+        m_timeToFirstRooms = m_streamingTimer.elapsed();
+        qDebug() << "Initial sync: first" << m_thread->appliedRooms() << "rooms shown after" << m_timeToFirstRooms << "ms";
+        Q_EMIT statisticsChanged();
+    }
+    Q_EMIT initialSyncProgress();
+}
+
+bool SyncScheduler::isSyncing() const
+{
+    return m_job || (m_thread && m_thread->isSyncing());
+}
+
+int SyncScheduler::longPollTimeout() const
+{
+    // In the background, only check for updates instead of waiting for them:
+    // a long poll would return and cause processing on every single event.
+    if (m_initialSync || m_state != Foreground) {
+        return 0;
+    }
+    return LongPollTimeout;
+}
+
+void SyncScheduler::onSyncSucceeded(qint64 bytesReceived, qint64 processingTime)
+{
+    m_initialSync = false;
+    m_failures = 0;
+
+    m_processingTime += processingTime;
+    m_bytesReceived += bytesReceived;
+
+    if (m_streaming) {
+        m_streaming = false;
+        qDebug() << "Initial sync:" << m_thread->appliedRooms() << "rooms," << bytesReceived << "bytes, complete after" << m_streamingTimer.elapsed() << "ms";
+        Q_EMIT initialSyncProgress();
+        if (!NeoChatConfig::self()->threadedSync()) {
+            m_thread->deleteLater();
+            m_thread = nullptr;
+        }
+    }
+
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    m_syncTimes += now;
+    while (!m_syncTimes.isEmpty() && m_syncTimes.first() < now - 60 * 60 * 1000) {
+        m_syncTimes.removeFirst();
+    }
+    Q_EMIT statisticsChanged();
+
+    Q_EMIT m_connection->syncDone();
+    scheduleNext();
+}
+
+void SyncScheduler::onSyncFailed(BaseJob::StatusCode error, const QString &errorString, const QString &rawDataSample)
+{
+    if (error == BaseJob::Abandoned) {
+        return;
+    }
+    if (error == BaseJob::ContentAccessError) {
+        qWarning() << "Sync failed with ContentAccessError - login expired?";
+        m_running = false;
+        Q_EMIT m_connection->loginError(errorString, rawDataSample);
+        return;
+    }
+
+    ++m_failures;
+    Q_EMIT m_connection->syncError(errorString, rawDataSample);
+    scheduleNext();
+}
+
+int SyncScheduler::retryInterval() const
+{
+    // Exponential backoff with +/-25% jitter so that clients that lost the
+    // connection at the same time don't come back at the same time.
+    const qint64 backoff = qMin<qint64>(qint64(MinRetryInterval) << qMin(m_failures - 1, 20), MaxRetryInterval);
+    const auto jitter = QRandomGenerator::global()->bounded(backoff / 2 + 1) - backoff / 4;
+    return int(backoff + jitter);
+}
+
+void SyncScheduler::scheduleNext()
+{
+    if (!m_running) {
+        return;
+    }
+    updateState();
+
+    switch (m_state) {
+    case Foreground:
+        sync();
+        break;
+    case Background:
+        m_timer.start(BackgroundInterval);
+        break;
+    case Idle:
+        m_timer.start(IdleInterval);
+        break;
+    case Failing:
+        m_timer.start(retryInterval());
+        break;
+    }
+}
+
+void SyncScheduler::updateState()
+{
+    State state;
+    if (m_failures > 0) {
+        state = Failing;
+    } else if (!m_hiddenSince.isValid()) {
+        state = Foreground;
+    } else if (m_hiddenSince.hasExpired(IdleThreshold)) {
+        state = Idle;
+    } else {
+        state = Background;
+    }
+
+    if (state != m_state) {
+        m_state = state;
+        Q_EMIT stateChanged();
+    }
+}
+
+SyncScheduler::State SyncScheduler::state() const
+{
+    return m_state;
+}
+
+int SyncScheduler::syncsPerHour() const
+{
+    return m_syncTimes.size();
+}
+
+qint64 SyncScheduler::bytesReceived() const
+{
+    return m_bytesReceived;
+}
+
+qint64 SyncScheduler::processingTime() const
+{
+    return m_processingTime;
+}
+
+qint64 SyncScheduler::timeToFirstRooms() const
+{
+    return m_timeToFirstRooms;
+}
+
+bool SyncScheduler::initialSyncRunning() const
+{
+    return m_streaming;
+}
+
+int SyncScheduler::initialSyncRooms() const
+{
+    return m_streaming ? m_thread->appliedRooms() : 0;
+}
+
+int SyncScheduler::initialSyncTotalRooms() const
+{
+    return m_streaming ? m_thread->totalRooms() : 0;
+}
+
+qint64 SyncScheduler::initialSyncBytes() const
+{
+    return m_streaming ? m_thread->bytesReceived() : 0;
+}
+
+qint64 SyncScheduler::initialSyncTotalBytes() const
+{
+    return m_streaming ? m_thread->bytesTotal() : -1;
+}
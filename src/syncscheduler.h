@@ -0,0 +1,134 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+#include <jobs/syncjob.h>
+
+namespace Quotient
+{
+class Connection;
+}
+
+class SyncFilter;
+class SyncThread;
+
+/// Decides when a connection syncs with its homeserver.
+///
+/// - While a window is shown, syncs are long-polled back to back, whether it
+///   has the focus or not.
+/// - While the application is in the background (window hidden to the tray
+///   or minimized), the server is polled without waiting for events, once a
+///   minute, and every few minutes once the application has been in the
+///   background for a while.
+/// - Failed syncs are retried with an exponential backoff and jitter.
+/// - Showing or activating the window triggers a sync immediately.
+///
+/// The scheduler runs the sync jobs itself, applies the results to the
+/// connection and emits Connection::syncDone() like Connection::sync() does.
+/// The syncs use the filter of SyncFilter. With the ThreadedSync setting,
+/// they are run by a SyncThread instead of a SyncJob. The initial sync of an
+/// account without cached state always uses a SyncThread, so that rooms show
+/// up while it is applied; its progress is exposed by the initialSync*
+/// properties. Every application of sync data to the connection, a whole
+/// response or a chunk of one, is framed by syncAboutToBeApplied() and
+/// syncApplied(), so that models can batch the changes it causes.
+class SyncScheduler : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(State state READ state NOTIFY stateChanged)
+    Q_PROPERTY(int syncsPerHour READ syncsPerHour NOTIFY statisticsChanged)
+    Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY statisticsChanged)
+    Q_PROPERTY(qint64 processingTime READ processingTime NOTIFY statisticsChanged)
+    Q_PROPERTY(qint64 timeToFirstRooms READ timeToFirstRooms NOTIFY statisticsChanged)
+
+    Q_PROPERTY(bool initialSyncRunning READ initialSyncRunning NOTIFY initialSyncProgress)
+    Q_PROPERTY(int initialSyncRooms READ initialSyncRooms NOTIFY initialSyncProgress)
+    Q_PROPERTY(int initialSyncTotalRooms READ initialSyncTotalRooms NOTIFY initialSyncProgress)
+    Q_PROPERTY(qint64 initialSyncBytes READ initialSyncBytes NOTIFY initialSyncProgress)
+    Q_PROPERTY(qint64 initialSyncTotalBytes READ initialSyncTotalBytes NOTIFY initialSyncProgress)
+
+public:
+    enum State {
+        Foreground,
+        Background,
+        Idle,
+        Failing,
+    };
+    Q_ENUM(State)
+
+    explicit SyncScheduler(Quotient::Connection *connection);
+
+    void start();
+    void stop();
+
+    /// Sync now unless a sync is already running.
+    void wake();
+
+    [[nodiscard]] State state() const;
+
+    /// Number of completed syncs in the last hour.
+    [[nodiscard]] int syncsPerHour() const;
+    /// Size of all sync responses received, in bytes.
+    [[nodiscard]] qint64 bytesReceived() const;
+    /// Time spent applying sync responses to the connection, in milliseconds.
+    [[nodiscard]] qint64 processingTime() const;
+    /// Time from the start of the initial sync until the first rooms were
+    /// applied, in milliseconds; -1 if there was no initial sync.
+    [[nodiscard]] qint64 timeToFirstRooms() const;
+
+    [[nodiscard]] bool initialSyncRunning() const;
+    [[nodiscard]] int initialSyncRooms() const;
+    [[nodiscard]] int initialSyncTotalRooms() const;
+    [[nodiscard]] qint64 initialSyncBytes() const;
+    /// -1 while unknown
+    [[nodiscard]] qint64 initialSyncTotalBytes() const;
+
+Q_SIGNALS:
+    void stateChanged();
+    void statisticsChanged();
+    void initialSyncProgress();
+    void syncAboutToBeApplied();
+    void syncApplied();
+
+private:
+    Quotient::Connection *m_connection;
+    SyncFilter *m_filter;
+    SyncThread *m_thread = nullptr;
+    QPointer<Quotient::SyncJob> m_job;
+    QTimer m_timer;
+    State m_state = Foreground;
+    bool m_running = false;
+    bool m_initialSync = true;
+    bool m_streaming = false;
+    QElapsedTimer m_streamingTimer;
+    qint64 m_timeToFirstRooms = -1;
+    int m_failures = 0;
+    QElapsedTimer m_hiddenSince;
+
+    QVector<qint64> m_syncTimes;
+    qint64 m_bytesReceived = 0;
+    qint64 m_processingTime = 0;
+
+    void sync();
+    /// Follow the visibility of the windows that aren't followed yet
+    void trackWindows();
+    void onVisibilityChanged();
+    void createThread();
+    void onThreadProgress();
+    [[nodiscard]] bool isSyncing() const;
+    void onSyncSucceeded(qint64 bytesReceived, qint64 processingTime);
+    void onSyncFailed(Quotient::BaseJob::StatusCode error, const QString &errorString, const QString &rawDataSample);
+    void scheduleNext();
+    void updateState();
+    [[nodiscard]] int longPollTimeout() const;
+    [[nodiscard]] int retryInterval() const;
+};
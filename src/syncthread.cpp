@@ -0,0 +1,320 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "syncthread.h"
+
+#include <algorithm>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrlQuery>
+#include <QVector>
+
+#include "connection.h"
+#include "networkaccessmanager.h"
+
+using namespace Quotient;
+
+static const int FirstChunkSize = 10;
+static const int RoomsPerChunk = 50;
+// Download progress is reported to the GUI thread in steps of this size
+static const qint64 ProgressStep = 256 * 1024;
+// On top of the long poll timeout of the server
+static const int TransferTimeout = 60 * 1000;
+
+SyncThread::SyncThread(Connection *connection, QObject *parent)
+    : QObject(parent)
+    , m_connection(connection)
+    , m_worker(new SyncWorker(this))
+{
+    m_thread.setObjectName(QStringLiteral("Sync %1").arg(connection->userId()));
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.start();
+}
+
+SyncThread::~SyncThread()
+{
+    abandon();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void SyncThread::sync(const QString &since, const QString &filter, int timeout, const QString &priorityRoomId)
+{
+    if (m_syncing) {
+        return;
+    }
+    m_syncing = true;
+    m_processingTime = 0;
+    m_appliedRooms = 0;
+    m_totalRooms = 0;
+    m_bytesReceived = 0;
+    m_bytesTotal = -1;
+
+    QUrl url = m_connection->homeserver();
+    url.setPath(url.path() + QStringLiteral("/_matrix/client/r0/sync"));
+    QUrlQuery query;
+    if (!since.isEmpty()) {
+        query.addQueryItem(QStringLiteral("since"), since);
+    }
+    if (!filter.isEmpty()) {
+        query.addQueryItem(QStringLiteral("filter"), QString::fromLatin1(QUrl::toPercentEncoding(filter)));
+    }
+    query.addQueryItem(QStringLiteral("timeout"), QString::number(timeout));
+    url.setQuery(query);
+
+    const int generation = m_generation;
+    const auto accessToken = m_connection->accessToken();
+    QMetaObject::invokeMethod(m_worker, [worker = m_worker, generation, url, accessToken, since, priorityRoomId, timeout] {
+        worker->sync(generation, url, accessToken, since, priorityRoomId, timeout);
+    });
+}
+
+void SyncThread::abandon()
+{
+    // Whatever the worker still delivers for the abandoned sync is dropped
+    ++m_generation;
+    m_syncing = false;
+    m_chunks.clear();
+    QMetaObject::invokeMethod(m_worker, [worker = m_worker] {
+        worker->abort();
+    });
+}
+
+bool SyncThread::isSyncing() const
+{
+    return m_syncing;
+}
+
+int SyncThread::appliedRooms() const
+{
+    return m_appliedRooms;
+}
+
+int SyncThread::totalRooms() const
+{
+    return m_totalRooms;
+}
+
+qint64 SyncThread::bytesReceived() const
+{
+    return m_bytesReceived;
+}
+
+qint64 SyncThread::bytesTotal() const
+{
+    return m_bytesTotal;
+}
+
+void SyncThread::updateDownload(int generation, qint64 bytesReceived, qint64 bytesTotal)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    m_bytesReceived = bytesReceived;
+    m_bytesTotal = bytesTotal;
+    Q_EMIT progress();
+}
+
+void SyncThread::enqueueChunk(int generation, const Chunk &chunk)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    m_chunks.enqueue(chunk);
+    scheduleNextChunk();
+}
+
+void SyncThread::scheduleNextChunk()
+{
+    if (m_chunkScheduled || m_chunks.isEmpty()) {
+        return;
+    }
+    // A timer rather than a posted event, so that the chunks already posted by
+    // the worker don't get applied back to back without rendering in between
+    m_chunkScheduled = true;
+    QTimer::singleShot(0, this, &SyncThread::applyNextChunk);
+}
+
+void SyncThread::applyNextChunk()
+{
+    m_chunkScheduled = false;
+    if (m_chunks.isEmpty()) {
+        return; // Abandoned in the meantime
+    }
+    const auto chunk = m_chunks.dequeue();
+
+    QElapsedTimer processing;
+    processing.start();
+    Q_EMIT chunkAboutToBeApplied();
+    m_connection->onSyncSuccess(std::move(*chunk.data));
+    Q_EMIT chunkApplied();
+    m_processingTime += processing.elapsed();
+
+    m_appliedRooms += chunk.rooms;
+    m_totalRooms = chunk.totalRooms;
+    Q_EMIT progress();
+
+    if (chunk.last) {
+        m_syncing = false;
+        Q_EMIT succeeded(m_bytesReceived, m_processingTime);
+        return;
+    }
+    scheduleNextChunk();
+}
+
+void SyncThread::fail(int generation, BaseJob::StatusCode error, const QString &errorString, const QString &rawDataSample)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    m_syncing = false;
+    Q_EMIT failed(error, errorString, rawDataSample);
+}
+
+SyncWorker::SyncWorker(SyncThread *syncThread)
+    : m_syncThread(syncThread)
+{
+}
+
+void SyncWorker::sync(int generation, const QUrl &url, const QByteArray &accessToken, const QString &since, const QString &priorityRoomId, int timeout)
+{
+    QNetworkRequest request(url);
+    request.setRawHeader("Authorization", "Bearer " + accessToken);
+    request.setTransferTimeout(timeout + TransferTimeout);
+    // One instance per thread, carrying the SSL error handling of libQuotient
+    m_reply = NetworkAccessManager::instance()->get(request);
+    m_reportedBytes = 0;
+    auto reply = m_reply.data();
+    connect(reply, &QNetworkReply::downloadProgress, this, [this, generation](qint64 bytesReceived, qint64 bytesTotal) {
+        if (bytesReceived - m_reportedBytes < ProgressStep && bytesReceived != bytesTotal) {
+            return;
+        }
+        m_reportedBytes = bytesReceived;
+        QMetaObject::invokeMethod(
+            m_syncThread,
+            [syncThread = m_syncThread, generation, bytesReceived, bytesTotal] {
+                syncThread->updateDownload(generation, bytesReceived, bytesTotal);
+            },
+            Qt::QueuedConnection);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, generation, reply, since, priorityRoomId] {
+        reply->deleteLater();
+        onFinished(generation, reply, since, priorityRoomId);
+    });
+}
+
+void SyncWorker::abort()
+{
+    if (m_reply) {
+        m_reply->abort();
+    }
+}
+
+void SyncWorker::onFinished(int generation, QNetworkReply *reply, const QString &since, const QString &priorityRoomId)
+{
+    if (generation != m_syncThread->m_generation) {
+        return;
+    }
+
+    const auto data = reply->readAll();
+    const auto post = [this](auto &&function) {
+        QMetaObject::invokeMethod(m_syncThread, std::forward<decltype(function)>(function), Qt::QueuedConnection);
+    };
+
+    const auto httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() != QNetworkReply::NoError) {
+        const auto error = httpStatus == 401 || httpStatus == 403 ? BaseJob::ContentAccessError : BaseJob::NetworkError;
+        const auto message = QJsonDocument::fromJson(data)[QLatin1String("error")].toString();
+        const auto errorString = message.isEmpty() ? reply->errorString() : message;
+        const auto sample = QString::fromUtf8(data.left(65535));
+        post([syncThread = m_syncThread, generation, error, errorString, sample] {
+            syncThread->fail(generation, error, errorString, sample);
+        });
+        return;
+    }
+
+    QJsonParseError parseError;
+    auto json = QJsonDocument::fromJson(data, &parseError).object();
+    if (parseError.error != QJsonParseError::NoError) {
+        const auto errorString = parseError.errorString();
+        const auto sample = QString::fromUtf8(data.left(65535));
+        post([syncThread = m_syncThread, generation, errorString, sample] {
+            syncThread->fail(generation, BaseJob::IncorrectResponse, errorString, sample);
+        });
+        return;
+    }
+
+    const qint64 responseSize = data.size();
+    post([syncThread = m_syncThread, generation, responseSize] {
+        syncThread->updateDownload(generation, responseSize, responseSize);
+    });
+
+    // Split the rooms into chunks; the first chunk carries everything else
+    // (account data, to-device events, ...), the last one the new batch token.
+    const auto nextBatch = json.take(QStringLiteral("next_batch"));
+    const auto rooms = json.take(QStringLiteral("rooms")).toObject();
+
+    struct Entry {
+        QString category;
+        QString roomId;
+        QJsonValue room;
+    };
+    QVector<Entry> entries;
+    for (auto category = rooms.begin(); category != rooms.end(); ++category) {
+        const auto categoryRooms = category.value().toObject();
+        for (auto room = categoryRooms.begin(); room != categoryRooms.end(); ++room) {
+            entries.append(Entry {category.key(), room.key(), room.value()});
+        }
+    }
+    std::stable_partition(entries.begin(), entries.end(), [](const Entry &entry) {
+        return entry.category == QLatin1String("invite");
+    });
+    std::stable_partition(entries.begin(), entries.end(), [&priorityRoomId](const Entry &entry) {
+        return entry.roomId == priorityRoomId;
+    });
+
+    QVector<QJsonObject> chunks;
+    QVector<int> chunkSizes;
+    for (int i = 0; i < entries.size();) {
+        const int size = chunks.isEmpty() ? FirstChunkSize : RoomsPerChunk;
+        QHash<QString, QJsonObject> chunkCategories;
+        int chunkSize = 0;
+        for (; i < entries.size() && chunkSize < size; ++i, ++chunkSize) {
+            chunkCategories[entries[i].category].insert(entries[i].roomId, entries[i].room);
+        }
+        QJsonObject chunkRooms;
+        for (auto category = chunkCategories.constBegin(); category != chunkCategories.constEnd(); ++category) {
+            chunkRooms.insert(category.key(), category.value());
+        }
+        chunks += QJsonObject {{QStringLiteral("rooms"), chunkRooms}};
+        chunkSizes += chunkSize;
+    }
+    if (chunks.isEmpty()) {
+        chunks += QJsonObject();
+        chunkSizes += 0;
+    }
+    for (auto it = json.constBegin(); it != json.constEnd(); ++it) {
+        chunks.first().insert(it.key(), it.value());
+    }
+
+    const int totalRooms = entries.size();
+    for (int i = 0; i < chunks.size(); ++i) {
+        const bool last = i == chunks.size() - 1;
+        chunks[i].insert(QStringLiteral("next_batch"), last ? nextBatch : QJsonValue(since));
+
+        auto data = std::make_shared<SyncData>();
+        data->parseJson(chunks[i]);
+        post([syncThread = m_syncThread, generation, chunk = SyncThread::Chunk {data, chunkSizes[i], totalRooms, last}] {
+            syncThread->enqueueChunk(generation, chunk);
+        });
+    }
+}
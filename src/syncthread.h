@@ -0,0 +1,119 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QThread>
+#include <QUrl>
+
+#include <atomic>
+#include <memory>
+
+#include "jobs/basejob.h"
+#include "syncdata.h"
+
+class QNetworkReply;
+
+namespace Quotient
+{
+class Connection;
+}
+
+class SyncWorker;
+
+/// Runs the syncs of a connection on a dedicated thread.
+///
+/// The request, the download and the JSON parsing happen on the worker
+/// thread, which splits the response into chunks of rooms. The chunks are
+/// queued on the GUI thread and applied to the connection one at a time, the
+/// next one only being scheduled once the previous one has been applied, so
+/// that the UI keeps rendering while a large sync is applied. The requests
+/// go through the libQuotient network access manager of the worker thread
+/// and so use the same proxy and SSL settings as the connection.
+/// Every chunk but the last keeps the previous batch token; only the last
+/// one moves the connection to the new token.
+///
+/// The first chunk is small and starts with the priority room and the
+/// invites, so that the room list and the open room show up quickly during
+/// an initial sync. progress() reports the download and the applied rooms.
+class SyncThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncThread(Quotient::Connection *connection, QObject *parent = nullptr);
+    ~SyncThread() override;
+
+    void sync(const QString &since, const QString &filter, int timeout, const QString &priorityRoomId = {});
+    void abandon();
+
+    [[nodiscard]] bool isSyncing() const;
+
+    [[nodiscard]] int appliedRooms() const;
+    [[nodiscard]] int totalRooms() const;
+    [[nodiscard]] qint64 bytesReceived() const;
+    /// -1 if the server didn't announce the size of the response
+    [[nodiscard]] qint64 bytesTotal() const;
+
+Q_SIGNALS:
+    /// All chunks of a sync have been applied to the connection.
+    void succeeded(qint64 bytesReceived, qint64 processingTime);
+    void progress();
+    /// Emitted around the application of every chunk
+    void chunkAboutToBeApplied();
+    void chunkApplied();
+    void failed(Quotient::BaseJob::StatusCode error, const QString &errorString, const QString &rawDataSample);
+
+private:
+    friend class SyncWorker;
+
+    Quotient::Connection *m_connection;
+    QThread m_thread;
+    SyncWorker *m_worker;
+    std::atomic<int> m_generation {0};
+    bool m_syncing = false;
+    qint64 m_processingTime = 0;
+    int m_appliedRooms = 0;
+    int m_totalRooms = 0;
+    qint64 m_bytesReceived = 0;
+    qint64 m_bytesTotal = -1;
+
+    struct Chunk {
+        std::shared_ptr<Quotient::SyncData> data;
+        int rooms;
+        int totalRooms;
+        bool last;
+    };
+    QQueue<Chunk> m_chunks;
+    bool m_chunkScheduled = false;
+
+    void updateDownload(int generation, qint64 bytesReceived, qint64 bytesTotal);
+    void enqueueChunk(int generation, const Chunk &chunk);
+    void scheduleNextChunk();
+    void applyNextChunk();
+    void fail(int generation, Quotient::BaseJob::StatusCode error, const QString &errorString, const QString &rawDataSample);
+};
+
+/// The part of SyncThread living on the worker thread.
+class SyncWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncWorker(SyncThread *syncThread);
+
+    void sync(int generation, const QUrl &url, const QByteArray &accessToken, const QString &since, const QString &priorityRoomId, int timeout);
+    void abort();
+
+private:
+    SyncThread *m_syncThread;
+    QPointer<QNetworkReply> m_reply;
+    qint64 m_reportedBytes = 0;
+
+    void onFinished(int generation, QNetworkReply *reply, const QString &since, const QString &priorityRoomId);
+};
@@ -0,0 +1,33 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "thumbnailjob.h"
+
+using namespace Quotient;
+
+ThumbnailJob::ThumbnailJob(const QString &serverName, const QString &mediaId, QSize requestedSize)
+    : GetContentThumbnailJob(serverName, mediaId, requestedSize.width(), requestedSize.height(), QStringLiteral("scale"))
+{
+}
+
+QByteArray ThumbnailJob::bytes() const
+{
+    return m_bytes;
+}
+
+QByteArray ThumbnailJob::mimeType() const
+{
+    return m_mimeType;
+}
+
+BaseJob::Status ThumbnailJob::prepareResult()
+{
+    m_mimeType = contentType().toLatin1();
+    m_bytes = data()->readAll();
+    if (m_bytes.isEmpty()) {
+        return {IncorrectResponse, QStringLiteral("Empty thumbnail")};
+    }
+    return Success;
+}
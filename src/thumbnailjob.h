@@ -0,0 +1,33 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+
+#include <csapi/content-repo.h>
+
+/// Downloads a thumbnail and keeps it as sent by the server.
+///
+/// Unlike Quotient::MediaThumbnailJob, the response isn't decoded on the
+/// thread of the connection; the image provider stores the bytes and
+/// decodes them when they are needed.
+class ThumbnailJob : public Quotient::GetContentThumbnailJob
+{
+public:
+    ThumbnailJob(const QString &serverName, const QString &mediaId, QSize requestedSize);
+
+    [[nodiscard]] QByteArray bytes() const;
+    [[nodiscard]] QByteArray mimeType() const;
+
+protected:
+    Status prepareResult() override;
+
+private:
+    QByteArray m_bytes;
+    QByteArray m_mimeType;
+};
@@ -0,0 +1,209 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include "thumbnailprefetcher.h"
+
+#include <QSize>
+
+#include <utility>
+
+#include "matriximageprovider.h"
+#include "neochatconfig.h"
+
+/// Requests this many times the prefetch distance away from the view are cancelled
+static const int DropFactor = 3;
+
+ThumbnailPrefetcher::ThumbnailPrefetcher(QObject *parent)
+    : QObject(parent)
+{
+    m_decodePool.setMaxThreadCount(1);
+}
+
+ThumbnailPrefetcher::~ThumbnailPrefetcher()
+{
+    cancelAll();
+    m_decodePool.waitForDone();
+}
+
+QAbstractItemModel *ThumbnailPrefetcher::model() const
+{
+    return m_model;
+}
+
+void ThumbnailPrefetcher::setModel(QAbstractItemModel *model)
+{
+    if (m_model == model) {
+        return;
+    }
+    if (m_model) {
+        m_model->disconnect(this);
+    }
+    cancelAll();
+    m_model = model;
+    if (m_model) {
+        connect(m_model, &QAbstractItemModel::modelReset, this, &ThumbnailPrefetcher::cancelAll);
+        const auto roles = m_model->roleNames();
+        m_thumbnailMediaIdRole = roles.key("thumbnailMediaId", -1);
+        m_thumbnailSizeRole = roles.key("thumbnailSize", -1);
+        m_avatarMediaIdRole = roles.key("authorAvatarMediaId", -1);
+    }
+    Q_EMIT modelChanged();
+}
+
+int ThumbnailPrefetcher::avatarSize() const
+{
+    return m_avatarSize;
+}
+
+void ThumbnailPrefetcher::setAvatarSize(int avatarSize)
+{
+    if (m_avatarSize == avatarSize) {
+        return;
+    }
+    m_avatarSize = avatarSize;
+    Q_EMIT avatarSizeChanged();
+}
+
+int ThumbnailPrefetcher::distance() const
+{
+    return m_distance;
+}
+
+void ThumbnailPrefetcher::setDistance(int distance)
+{
+    if (m_distance == distance) {
+        return;
+    }
+    m_distance = distance;
+    Q_EMIT distanceChanged();
+}
+
+void ThumbnailPrefetcher::setVisibleRange(int first, int last)
+{
+    if (!m_model || first < 0 || last < 0) {
+        return;
+    }
+    if (first > last) {
+        std::swap(first, last);
+    }
+    if (first == m_first && last == m_last) {
+        return;
+    }
+    // Towards higher rows unless the view moved the other way
+    const bool forward = m_first < 0 || first > m_first || last > m_last;
+    m_first = first;
+    m_last = last;
+
+    // Rows move as events arrive, so the rows of the requests are only approximate
+    const int dropDistance = m_distance * DropFactor;
+    for (auto it = m_prefetches.begin(); it != m_prefetches.end();) {
+        if (it->row < first - dropDistance || it->row > last + dropDistance) {
+            it->response->disconnect(this);
+            // Stops waiting for its download
+            it->response->deleteLater();
+            // Requested again when it comes close again
+            m_done.remove(it.key());
+            it = m_prefetches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (forward) {
+        prefetch(last + 1, last + m_distance);
+    } else {
+        prefetch(first - m_distance, first - 1);
+    }
+}
+
+void ThumbnailPrefetcher::prefetch(int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, m_model->rowCount() - 1);
+    const bool avatars = m_avatarSize > 0 && NeoChatConfig::self()->showAvatarInTimeline();
+    for (int row = first; row <= last; ++row) {
+        const auto index = m_model->index(row, 0);
+        if (m_thumbnailMediaIdRole >= 0) {
+            request(index.data(m_thumbnailMediaIdRole).toString(), index.data(m_thumbnailSizeRole).toSize(), row);
+        }
+        if (avatars && m_avatarMediaIdRole >= 0) {
+            request(index.data(m_avatarMediaIdRole).toString(), QSize(m_avatarSize, m_avatarSize), row);
+        }
+    }
+}
+
+void ThumbnailPrefetcher::request(const QString &mediaId, const QSize &size, int row)
+{
+    if (mediaId.isEmpty()) {
+        return;
+    }
+    const auto key = QStringLiteral("%1@%2x%3").arg(mediaId, QString::number(size.width()), QString::number(size.height()));
+    if (m_prefetches.contains(key) || m_done.contains(key)) {
+        return;
+    }
+    m_done.insert(key);
+
+    // Creating the response looks the image up in the image cache and probes
+    // the disk cache, which stays off the main thread as for the image provider
+    m_decodePool.start([self = QPointer<ThumbnailPrefetcher>(this), generation = m_generation, mediaId, size, key, row] {
+        auto response = new ThumbnailResponse(mediaId, size, true);
+        if (response->isFinished()) {
+            response->decodeIntoCache();
+            delete response;
+            return;
+        }
+        // The response moved itself to the main thread to wait for its download
+        QMetaObject::invokeMethod(
+            response,
+            [self, generation, key, row, response] {
+                if (!self || generation != self->m_generation) {
+                    // Stops waiting for its download
+                    response->deleteLater();
+                    return;
+                }
+                self->track(key, row, response);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void ThumbnailPrefetcher::track(const QString &key, int row, ThumbnailResponse *response)
+{
+    if (response->isFinished()) {
+        decode(response);
+        return;
+    }
+    m_prefetches.insert(key, Prefetch {response, row});
+    connect(response, &QQuickImageResponse::finished, this, [this, key, response] {
+        const auto it = m_prefetches.find(key);
+        if (it != m_prefetches.end() && it->response == response) {
+            m_prefetches.erase(it);
+        }
+        decode(response);
+    });
+}
+
+void ThumbnailPrefetcher::decode(ThumbnailResponse *response)
+{
+    m_decodePool.start([response] {
+        response->decodeIntoCache();
+        QMetaObject::invokeMethod(response, &QObject::deleteLater, Qt::QueuedConnection);
+    });
+}
+
+void ThumbnailPrefetcher::cancelAll()
+{
+    for (const auto &prefetch : qAsConst(m_prefetches)) {
+        prefetch.response->disconnect(this);
+        // Stops waiting for its download
+        prefetch.response->deleteLater();
+    }
+    m_prefetches.clear();
+    m_done.clear();
+    // Responses still being created are dropped once they are
+    ++m_generation;
+    m_first = -1;
+    m_last = -1;
+}
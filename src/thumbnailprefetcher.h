@@ -0,0 +1,85 @@
+/**
+ * SPDX-FileCopyrightText: 2021 NeoChat Contributors
+ *
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+
+class ThumbnailResponse;
+
+/// Loads the thumbnails and avatars of the timeline just outside the view.
+///
+/// The view reports the rows it shows; the images of the next rows in the
+/// direction of scrolling are requested from the image provider and decoded
+/// into its image cache on a background thread, so they are there when
+/// their delegates are created. The requests are created on that thread as
+/// well, since they look for the images in the caches first. Requests that fall far behind the view are
+/// cancelled.
+///
+/// The model needs the thumbnail and author avatar roles of
+/// MessageEventModel.
+class ThumbnailPrefetcher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QAbstractItemModel *model READ model WRITE setModel NOTIFY modelChanged)
+    /// Size avatars are requested in
+    Q_PROPERTY(int avatarSize READ avatarSize WRITE setAvatarSize NOTIFY avatarSizeChanged)
+    /// Rows ahead of the view to prefetch
+    Q_PROPERTY(int distance READ distance WRITE setDistance NOTIFY distanceChanged)
+
+public:
+    explicit ThumbnailPrefetcher(QObject *parent = nullptr);
+    ~ThumbnailPrefetcher() override;
+
+    [[nodiscard]] QAbstractItemModel *model() const;
+    void setModel(QAbstractItemModel *model);
+
+    [[nodiscard]] int avatarSize() const;
+    void setAvatarSize(int avatarSize);
+
+    [[nodiscard]] int distance() const;
+    void setDistance(int distance);
+
+    /// Call with the first and last row shown whenever the view scrolls
+    Q_INVOKABLE void setVisibleRange(int first, int last);
+
+Q_SIGNALS:
+    void modelChanged();
+    void avatarSizeChanged();
+    void distanceChanged();
+
+private:
+    struct Prefetch {
+        ThumbnailResponse *response;
+        int row;
+    };
+
+    QPointer<QAbstractItemModel> m_model;
+    int m_thumbnailMediaIdRole = -1;
+    int m_thumbnailSizeRole = -1;
+    int m_avatarMediaIdRole = -1;
+    int m_avatarSize = 0;
+    int m_distance = 10;
+    int m_first = -1;
+    int m_last = -1;
+    /// Unfinished requests, by media ID and size
+    QHash<QString, Prefetch> m_prefetches;
+    /// Everything requested since the last reset, which the image cache has now
+    QSet<QString> m_done;
+    /// Incremented whenever the requests are cancelled
+    int m_generation = 0;
+    QThreadPool m_decodePool;
+
+    void prefetch(int first, int last);
+    void request(const QString &mediaId, const QSize &size, int row);
+    void track(const QString &key, int row, ThumbnailResponse *response);
+    void decode(ThumbnailResponse *response);
+    void cancelAll();
+};
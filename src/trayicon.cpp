@@ -42,3 +42,15 @@ void TrayIcon::setIconSource(const QString &source)
     setIconByName(source);
     Q_EMIT iconSourceChanged();
 }
+
+void TrayIcon::setNotificationCount(int notificationCount, int highlightCount)
+{
+    if (m_notificationCount == notificationCount && (status() == NeedsAttention) == (highlightCount > 0)) {
+        return;
+    }
+    m_notificationCount = notificationCount;
+    setToolTipTitle(QStringLiteral("NeoChat"));
+    setToolTipSubTitle(notificationCount > 0 ? i18np("%1 unread notification", "%1 unread notifications", notificationCount) : QString());
+    setStatus(highlightCount > 0 ? NeedsAttention : Active);
+    Q_EMIT notificationCountChanged();
+}
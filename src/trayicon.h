@@ -20,6 +20,7 @@ class TrayIcon : public KStatusNotifierItem
     Q_OBJECT
     Q_PROPERTY(QString iconSource READ iconSource WRITE setIconSource NOTIFY iconSourceChanged)
     Q_PROPERTY(bool isOnline READ isOnline WRITE setIsOnline NOTIFY isOnlineChanged)
+    Q_PROPERTY(int notificationCount READ notificationCount NOTIFY notificationCountChanged)
 public:
     TrayIcon(QObject *parent = nullptr);
 
@@ -35,6 +36,12 @@ public:
     }
     void setIsOnline(bool online);
 
+    int notificationCount() const
+    {
+        return m_notificationCount;
+    }
+    void setNotificationCount(int notificationCount, int highlightCount);
+
 Q_SIGNALS:
     void notificationCountChanged();
     void iconSourceChanged();
@@ -45,6 +52,7 @@ Q_SIGNALS:
 private:
     QString m_iconSource;
     bool m_isOnline = true;
+    int m_notificationCount = 0;
 };
 
 #endif // TRAYICON_H